@@ -0,0 +1,105 @@
+#ifndef EVO_THREADS_ASYNC_H_DEFINED
+#define EVO_THREADS_ASYNC_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <evo/threads/threads.h>
+
+/*---------------------------- types ----------------------------*/
+
+/*
+ * Locks that never block the caller. Acquiring hands over a continuation
+ * that runs once a permit is available: right away when one is free, or
+ * when release() passes one on. Permits go to waiting continuations in
+ * FIFO order and a continuation owns its permit until it calls release()
+ * itself, possibly much later and from another thread.
+ *
+ * Continuations passed on by release() go to `post`, typically a thread
+ * pool submit; without one they run on the releasing thread. Either way
+ * the thread that runs them never waits for the lock.
+ */
+typedef void (*async_post_t)(void *ctx, void (*func)(void *), void *arg);
+
+typedef struct async_waiter {
+  struct async_waiter *next;
+  void (*func)(void *);
+  void *arg;
+} async_waiter_t;
+
+typedef struct {
+  mtx_t mtx;
+  unsigned count;          /* free permits */
+  async_waiter_t *head;    /* waiting continuations (FIFO) */
+  async_waiter_t *tail;
+  async_post_t post;       /* NULL to run on the releasing thread */
+  void *ctx;
+} async_sem_t;
+
+/* An async_sem_t with a single permit */
+typedef async_sem_t async_mtx_t;
+
+/*-------------------------- functions --------------------------*/
+
+EVO_THREADS_API
+int
+async_sem_init(async_sem_t *, unsigned count, async_post_t post, void *ctx);
+
+/* No continuation may be waiting */
+EVO_THREADS_API
+void
+async_sem_destroy(async_sem_t *);
+
+/*
+ * Runs func(arg) with a permit. When one is free it runs on the calling
+ * thread before this returns (after the current continuation, if called
+ * from one); otherwise it waits in `waiter`, caller storage that must
+ * stay valid until func is called.
+ */
+EVO_THREADS_API
+void
+async_sem_acquire(async_sem_t *, async_waiter_t *waiter, void (*func)(void *), void *arg);
+
+/* Takes a permit only if one is free at once; thrd_busy otherwise */
+EVO_THREADS_API
+int
+async_sem_tryacquire(async_sem_t *);
+
+/* Passes the permit to the first waiting continuation, or frees it */
+EVO_THREADS_API
+void
+async_sem_release(async_sem_t *);
+
+static inline int
+async_mtx_init(async_mtx_t *mtx, async_post_t post, void *ctx) {
+  return async_sem_init(mtx, 1, post, ctx);
+}
+
+static inline void
+async_mtx_destroy(async_mtx_t *mtx) {
+  async_sem_destroy(mtx);
+}
+
+static inline void
+async_mtx_lock(async_mtx_t *mtx, async_waiter_t *waiter, void (*func)(void *), void *arg) {
+  async_sem_acquire(mtx, waiter, func, arg);
+}
+
+static inline int
+async_mtx_trylock(async_mtx_t *mtx) {
+  return async_sem_tryacquire(mtx);
+}
+
+static inline void
+async_mtx_unlock(async_mtx_t *mtx) {
+  async_sem_release(mtx);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_THREADS_ASYNC_H_DEFINED */
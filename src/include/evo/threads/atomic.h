@@ -0,0 +1,449 @@
+#ifndef EVO_ATOMIC_H_DEFINED
+#define EVO_ATOMIC_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Header-only atomics shared by the library and its users.
+ *
+ * Works the same from C and C++ (no <stdatomic.h>/<atomic> mixing): GCC and
+ * Clang use the __atomic builtins, MSVC the Interlocked intrinsics. Every
+ * operation takes an explicit EVO_ATOMIC_* memory order; the objects are
+ * plain integers/pointers that must only be accessed through these calls.
+ */
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#  include <intrin.h>
+#  define EVO_ATOMIC_MSVC 1
+#elif !defined(__GNUC__)
+#  error Not supported on this compiler.
+#endif
+
+/*---------------------------- macros ---------------------------*/
+
+#if defined(EVO_ATOMIC_MSVC)
+#  define EVO_ATOMIC_RELAXED 0
+#  define EVO_ATOMIC_CONSUME 1
+#  define EVO_ATOMIC_ACQUIRE 2
+#  define EVO_ATOMIC_RELEASE 3
+#  define EVO_ATOMIC_ACQ_REL 4
+#  define EVO_ATOMIC_SEQ_CST 5
+#  define EVO_ATOMIC_INLINE static __forceinline
+#  define EVO_ALIGNAS(n) __declspec(align(n))
+#else
+#  define EVO_ATOMIC_RELAXED __ATOMIC_RELAXED
+#  define EVO_ATOMIC_CONSUME __ATOMIC_CONSUME
+#  define EVO_ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#  define EVO_ATOMIC_RELEASE __ATOMIC_RELEASE
+#  define EVO_ATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+#  define EVO_ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+#  define EVO_ATOMIC_INLINE static inline __attribute__((always_inline))
+#  define EVO_ALIGNAS(n) __attribute__((aligned(n)))
+#endif
+
+/*
+ * Distance that keeps two objects from false sharing. Apple M-series and
+ * POWER use 128 byte lines; x86 prefetches lines in adjacent pairs, so 128
+ * is also the safe padding there even though the line itself is 64 bytes.
+ */
+#ifndef EVO_CACHE_LINE_SIZE
+#  if defined(__APPLE__) && defined(__aarch64__)
+#    define EVO_CACHE_LINE_SIZE 128
+#  elif defined(__powerpc64__) || defined(__ppc64__)
+#    define EVO_CACHE_LINE_SIZE 128
+#  else
+#    define EVO_CACHE_LINE_SIZE 64
+#  endif
+#endif
+
+#ifndef EVO_CACHE_LINE_PAD_SIZE
+#  if defined(__x86_64__) || defined(_M_X64)
+#    define EVO_CACHE_LINE_PAD_SIZE 128
+#  else
+#    define EVO_CACHE_LINE_PAD_SIZE EVO_CACHE_LINE_SIZE
+#  endif
+#endif
+
+/* Aligns a type or object to its own cache line */
+#define EVO_CACHE_ALIGNED EVO_ALIGNAS(EVO_CACHE_LINE_SIZE)
+
+/* Pads the rest of the cache line after a member of the given size */
+#define EVO_CACHE_LINE_PAD(name, used) \
+  char name[EVO_CACHE_LINE_PAD_SIZE - ((used) % EVO_CACHE_LINE_PAD_SIZE)]
+
+/*---------------------------- types ----------------------------*/
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#  define EVO_ATOMIC_PAIR_ALIGN 16
+#else
+#  define EVO_ATOMIC_PAIR_ALIGN 8
+#endif
+
+/* Operand of the double-width compare-and-swap */
+typedef struct EVO_ALIGNAS(EVO_ATOMIC_PAIR_ALIGN) {
+  uintptr_t lo;
+  uintptr_t hi;
+} evo_atomic_pair_t;
+
+/*-------------------------- functions --------------------------*/
+
+/*
+ * Per type (i32, u32, i64, u64, uptr):
+ *   evo_atomic_load_T, evo_atomic_store_T, evo_atomic_exchange_T,
+ *   evo_atomic_cas_T, evo_atomic_cas_weak_T, evo_atomic_fetch_add_T,
+ *   evo_atomic_fetch_sub_T, evo_atomic_fetch_or_T, evo_atomic_fetch_and_T
+ * and for void *: load, store, exchange and cas.
+ *
+ * cas returns non-zero on success; on failure the current value is
+ * written to *expected. The failure ordering is derived from `order`.
+ */
+
+#if defined(EVO_ATOMIC_MSVC)
+
+/*
+ * Orders a plain load before what follows: x86 loads already acquire,
+ * so only the compiler needs holding back. Seq-cst stores are full
+ * barriers (xchg, or dmb on ARM64), which makes this enough for a
+ * seq-cst load as well.
+ */
+#if defined(_M_IX86) || defined(_M_X64)
+#  define EVO_ATOMIC_LOAD_FENCE_() _ReadWriteBarrier()
+#else
+#  define EVO_ATOMIC_LOAD_FENCE_() __dmb(_ARM64_BARRIER_ISH)
+#endif
+
+/* Loads and stores of objects no wider than a register */
+#define EVO_ATOMIC_DEFINE_LOAD_STORE_(sfx, type, itype, isfx)                \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_load_##sfx(const volatile type *p, int order) {                \
+    type v = *p;                                                            \
+    if (order != EVO_ATOMIC_RELAXED)                                        \
+      EVO_ATOMIC_LOAD_FENCE_();                                             \
+    return v;                                                               \
+  }                                                                         \
+  EVO_ATOMIC_INLINE void                                                    \
+  evo_atomic_store_##sfx(volatile type *p, type v, int order) {             \
+    if (order == EVO_ATOMIC_RELAXED)                                        \
+      *p = v;                                                               \
+    else                                                                    \
+      _InterlockedExchange##isfx((volatile itype *)p, (itype)v);            \
+  }
+
+/*
+ * 64-bit loads and stores on 32-bit x86, where two moves could tear: the
+ * load is a CAS, so it needs a writable object even when relaxed.
+ */
+#define EVO_ATOMIC_DEFINE_LOAD_STORE_WIDE_(sfx, type)                        \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_load_##sfx(const volatile type *p, int order) {                \
+    (void)order;                                                            \
+    return (type)_InterlockedCompareExchange64((volatile __int64 *)p, 0, 0); \
+  }                                                                         \
+  EVO_ATOMIC_INLINE void                                                    \
+  evo_atomic_store_##sfx(volatile type *p, type v, int order) {             \
+    (void)order;                                                            \
+    _InterlockedExchange64((volatile __int64 *)p, (__int64)v);              \
+  }
+
+#define EVO_ATOMIC_DEFINE_(sfx, type, itype, isfx)                           \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_exchange_##sfx(volatile type *p, type v, int order) {          \
+    (void)order;                                                            \
+    return (type)_InterlockedExchange##isfx((volatile itype *)p, (itype)v); \
+  }                                                                         \
+  EVO_ATOMIC_INLINE int                                                     \
+  evo_atomic_cas_##sfx(volatile type *p, type *expected, type desired,      \
+                       int order) {                                         \
+    itype old;                                                              \
+    (void)order;                                                            \
+    old = _InterlockedCompareExchange##isfx((volatile itype *)p,            \
+                                            (itype)desired,                 \
+                                            (itype)*expected);              \
+    if (old == (itype)*expected)                                            \
+      return 1;                                                             \
+    *expected = (type)old;                                                  \
+    return 0;                                                               \
+  }                                                                         \
+  EVO_ATOMIC_INLINE int                                                     \
+  evo_atomic_cas_weak_##sfx(volatile type *p, type *expected, type desired, \
+                            int order) {                                    \
+    return evo_atomic_cas_##sfx(p, expected, desired, order);               \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_add_##sfx(volatile type *p, type v, int order) {         \
+    (void)order;                                                            \
+    return (type)_InterlockedExchangeAdd##isfx((volatile itype *)p,         \
+                                               (itype)v);                   \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_sub_##sfx(volatile type *p, type v, int order) {         \
+    (void)order;                                                            \
+    return (type)_InterlockedExchangeAdd##isfx((volatile itype *)p,         \
+                                               -(itype)v);                  \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_or_##sfx(volatile type *p, type v, int order) {          \
+    (void)order;                                                            \
+    return (type)_InterlockedOr##isfx((volatile itype *)p, (itype)v);       \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_and_##sfx(volatile type *p, type v, int order) {         \
+    (void)order;                                                            \
+    return (type)_InterlockedAnd##isfx((volatile itype *)p, (itype)v);      \
+  }
+
+EVO_ATOMIC_DEFINE_LOAD_STORE_(i32, int32_t, long, )
+EVO_ATOMIC_DEFINE_LOAD_STORE_(u32, uint32_t, long, )
+#if UINTPTR_MAX > 0xFFFFFFFFu
+EVO_ATOMIC_DEFINE_LOAD_STORE_(i64, int64_t, __int64, 64)
+EVO_ATOMIC_DEFINE_LOAD_STORE_(u64, uint64_t, __int64, 64)
+EVO_ATOMIC_DEFINE_LOAD_STORE_(uptr, uintptr_t, __int64, 64)
+#else
+EVO_ATOMIC_DEFINE_LOAD_STORE_WIDE_(i64, int64_t)
+EVO_ATOMIC_DEFINE_LOAD_STORE_WIDE_(u64, uint64_t)
+EVO_ATOMIC_DEFINE_LOAD_STORE_(uptr, uintptr_t, long, )
+#endif
+
+EVO_ATOMIC_DEFINE_(i32, int32_t, long, )
+EVO_ATOMIC_DEFINE_(u32, uint32_t, long, )
+EVO_ATOMIC_DEFINE_(i64, int64_t, __int64, 64)
+EVO_ATOMIC_DEFINE_(u64, uint64_t, __int64, 64)
+#if UINTPTR_MAX > 0xFFFFFFFFu
+EVO_ATOMIC_DEFINE_(uptr, uintptr_t, __int64, 64)
+#else
+EVO_ATOMIC_DEFINE_(uptr, uintptr_t, long, )
+#endif
+
+#undef EVO_ATOMIC_DEFINE_LOAD_STORE_
+#undef EVO_ATOMIC_DEFINE_LOAD_STORE_WIDE_
+#undef EVO_ATOMIC_DEFINE_
+
+EVO_ATOMIC_INLINE void *
+evo_atomic_load_ptr(void *const volatile *p, int order) {
+  void *v = *p;
+  if (order != EVO_ATOMIC_RELAXED)
+    EVO_ATOMIC_LOAD_FENCE_();
+  return v;
+}
+
+#undef EVO_ATOMIC_LOAD_FENCE_
+
+EVO_ATOMIC_INLINE void
+evo_atomic_store_ptr(void *volatile *p, void *v, int order) {
+  if (order == EVO_ATOMIC_RELAXED)
+    *p = v;
+  else
+    _InterlockedExchangePointer(p, v);
+}
+
+EVO_ATOMIC_INLINE void *
+evo_atomic_exchange_ptr(void *volatile *p, void *v, int order) {
+  (void)order;
+  return _InterlockedExchangePointer(p, v);
+}
+
+EVO_ATOMIC_INLINE int
+evo_atomic_cas_ptr(void *volatile *p, void **expected, void *desired,
+                   int order) {
+  void *old;
+  (void)order;
+  old = _InterlockedCompareExchangePointer(p, desired, *expected);
+  if (old == *expected)
+    return 1;
+  *expected = old;
+  return 0;
+}
+
+EVO_ATOMIC_INLINE int
+evo_atomic_cas2(volatile evo_atomic_pair_t *p, evo_atomic_pair_t *expected,
+                evo_atomic_pair_t desired, int order) {
+  (void)order;
+#if defined(_M_X64) || defined(_M_ARM64)
+  return _InterlockedCompareExchange128((volatile __int64 *)p,
+                                        (__int64)desired.hi,
+                                        (__int64)desired.lo,
+                                        (__int64 *)expected);
+#else
+  {
+    __int64 cmp = (__int64)expected->lo | ((__int64)expected->hi << 32);
+    __int64 val = (__int64)desired.lo | ((__int64)desired.hi << 32);
+    __int64 old = _InterlockedCompareExchange64((volatile __int64 *)p, val, cmp);
+    if (old == cmp)
+      return 1;
+    expected->lo = (uintptr_t)(old & 0xFFFFFFFF);
+    expected->hi = (uintptr_t)((unsigned __int64)old >> 32);
+    return 0;
+  }
+#endif
+}
+
+EVO_ATOMIC_INLINE void
+evo_atomic_thread_fence(int order) {
+  if (order == EVO_ATOMIC_RELAXED)
+    return;
+#if defined(_M_IX86) || defined(_M_X64)
+  if (order == EVO_ATOMIC_SEQ_CST)
+    _mm_mfence();
+  else
+    _ReadWriteBarrier();
+#else
+  __dmb(_ARM64_BARRIER_ISH);
+#endif
+}
+
+EVO_ATOMIC_INLINE void
+evo_atomic_signal_fence(int order) {
+  (void)order;
+  _ReadWriteBarrier();
+}
+
+EVO_ATOMIC_INLINE void
+evo_cpu_relax(void) {
+#if defined(_M_IX86) || defined(_M_X64)
+  _mm_pause();
+#else
+  __yield();
+#endif
+}
+
+#else /* GCC, Clang */
+
+/* The failure ordering of a CAS may not contain a release */
+#define EVO_ATOMIC_FAIL_ORDER_(order)                                        \
+  ((order) == EVO_ATOMIC_ACQ_REL ? EVO_ATOMIC_ACQUIRE                       \
+   : (order) == EVO_ATOMIC_RELEASE ? EVO_ATOMIC_RELAXED : (order))
+
+#define EVO_ATOMIC_DEFINE_(sfx, type)                                        \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_load_##sfx(const volatile type *p, int order) {                \
+    return __atomic_load_n(p, order);                                       \
+  }                                                                         \
+  EVO_ATOMIC_INLINE void                                                    \
+  evo_atomic_store_##sfx(volatile type *p, type v, int order) {             \
+    __atomic_store_n(p, v, order);                                          \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_exchange_##sfx(volatile type *p, type v, int order) {          \
+    return __atomic_exchange_n(p, v, order);                                \
+  }                                                                         \
+  EVO_ATOMIC_INLINE int                                                     \
+  evo_atomic_cas_##sfx(volatile type *p, type *expected, type desired,      \
+                       int order) {                                         \
+    return __atomic_compare_exchange_n(p, expected, desired, 0, order,      \
+                                       EVO_ATOMIC_FAIL_ORDER_(order));      \
+  }                                                                         \
+  EVO_ATOMIC_INLINE int                                                     \
+  evo_atomic_cas_weak_##sfx(volatile type *p, type *expected, type desired, \
+                            int order) {                                    \
+    return __atomic_compare_exchange_n(p, expected, desired, 1, order,      \
+                                       EVO_ATOMIC_FAIL_ORDER_(order));      \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_add_##sfx(volatile type *p, type v, int order) {         \
+    return __atomic_fetch_add(p, v, order);                                 \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_sub_##sfx(volatile type *p, type v, int order) {         \
+    return __atomic_fetch_sub(p, v, order);                                 \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_or_##sfx(volatile type *p, type v, int order) {          \
+    return __atomic_fetch_or(p, v, order);                                  \
+  }                                                                         \
+  EVO_ATOMIC_INLINE type                                                    \
+  evo_atomic_fetch_and_##sfx(volatile type *p, type v, int order) {         \
+    return __atomic_fetch_and(p, v, order);                                 \
+  }
+
+EVO_ATOMIC_DEFINE_(i32, int32_t)
+EVO_ATOMIC_DEFINE_(u32, uint32_t)
+EVO_ATOMIC_DEFINE_(i64, int64_t)
+EVO_ATOMIC_DEFINE_(u64, uint64_t)
+EVO_ATOMIC_DEFINE_(uptr, uintptr_t)
+
+#undef EVO_ATOMIC_DEFINE_
+
+EVO_ATOMIC_INLINE void *
+evo_atomic_load_ptr(void *const volatile *p, int order) {
+  return __atomic_load_n(p, order);
+}
+
+EVO_ATOMIC_INLINE void
+evo_atomic_store_ptr(void *volatile *p, void *v, int order) {
+  __atomic_store_n(p, v, order);
+}
+
+EVO_ATOMIC_INLINE void *
+evo_atomic_exchange_ptr(void *volatile *p, void *v, int order) {
+  return __atomic_exchange_n(p, v, order);
+}
+
+EVO_ATOMIC_INLINE int
+evo_atomic_cas_ptr(void *volatile *p, void **expected, void *desired,
+                   int order) {
+  return __atomic_compare_exchange_n(p, expected, desired, 0, order,
+                                     EVO_ATOMIC_FAIL_ORDER_(order));
+}
+
+/*
+ * x86-64 needs cmpxchg16b, which GCC only emits inline with -mcx16 and
+ * otherwise routes through libatomic, so it is spelled out here. Other
+ * 64-bit targets may still call into libatomic (link with -latomic).
+ */
+EVO_ATOMIC_INLINE int
+evo_atomic_cas2(volatile evo_atomic_pair_t *p, evo_atomic_pair_t *expected,
+                evo_atomic_pair_t desired, int order) {
+#if defined(__x86_64__)
+  unsigned char ok;
+  (void)order;
+  __asm__ __volatile__ ("lock; cmpxchg16b %1\n\tsete %0"
+                        : "=q" (ok), "+m" (*p),
+                          "+a" (expected->lo), "+d" (expected->hi)
+                        : "b" (desired.lo), "c" (desired.hi)
+                        : "memory", "cc");
+  return ok;
+#else
+  return __atomic_compare_exchange((evo_atomic_pair_t *)p, expected, &desired,
+                                   0, order, EVO_ATOMIC_FAIL_ORDER_(order));
+#endif
+}
+
+EVO_ATOMIC_INLINE void
+evo_atomic_thread_fence(int order) {
+  __atomic_thread_fence(order);
+}
+
+EVO_ATOMIC_INLINE void
+evo_atomic_signal_fence(int order) {
+  __atomic_signal_fence(order);
+}
+
+EVO_ATOMIC_INLINE void
+evo_cpu_relax(void) {
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+  __asm__ __volatile__ ("yield" ::: "memory");
+#elif defined(__powerpc__) || defined(__ppc__)
+  __asm__ __volatile__ ("or 27,27,27" ::: "memory");
+#elif defined(__riscv)
+  __asm__ __volatile__ (".insn i 0x0F, 0, x0, x0, 0x010" ::: "memory"); /* pause */
+#else
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+#endif /* EVO_ATOMIC_MSVC */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_ATOMIC_H_DEFINED */
@@ -0,0 +1,112 @@
+#ifndef EVO_THREADS_CANCEL_H_DEFINED
+#define EVO_THREADS_CANCEL_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <evo/threads/threads.h>
+#include <evo/threads/atomic.h>
+
+#include <stdint.h>
+
+/*---------------------------- types ----------------------------*/
+
+/*
+ * Cooperative cancellation. The owner of a cancel_source_t requests
+ * cancellation; code handed its token polls cancel_requested() or blocks
+ * in one of the *_cancellable() waits below, which return as soon as the
+ * token fires instead of at their next timeout.
+ */
+typedef struct cancel_callback {
+  struct cancel_callback *next;
+  struct cancel_callback *prev;
+  void (*func)(void *);
+  void *arg;
+  int linked;
+} cancel_callback_t;
+
+typedef struct cancel_source {
+  uint32_t cancelled;
+  mtx_t mtx;
+  cnd_t cnd;                    /* cancellable sleeps, callback completion */
+  cancel_callback_t *callbacks;
+  cancel_callback_t *running;
+} cancel_source_t;
+
+/* Read-only view of a source; NULL is a token that never fires */
+typedef const struct cancel_source *cancel_token_t;
+
+/*-------------------------- functions --------------------------*/
+
+EVO_THREADS_API
+int
+cancel_source_init(cancel_source_t *);
+
+EVO_THREADS_API
+void
+cancel_source_destroy(cancel_source_t *);
+
+/* Sets the token and runs the registered callbacks once, in this thread */
+EVO_THREADS_API
+void
+cancel_request(cancel_source_t *);
+
+static inline cancel_token_t
+cancel_source_token(const cancel_source_t *src) {
+  return src;
+}
+
+/* A single relaxed load, cheap enough for inner loops */
+static inline int
+cancel_requested(cancel_token_t token) {
+  return token && evo_atomic_load_u32(&token->cancelled, EVO_ATOMIC_RELAXED) != 0;
+}
+
+/*
+ * Runs func(arg) when the token fires. Returns thrd_cancelled without
+ * registering (or calling) anything if it already has. `cb` is caller
+ * storage that must stay valid until cancel_unregister().
+ */
+EVO_THREADS_API
+int
+cancel_register(cancel_token_t, cancel_callback_t *cb, void (*func)(void *), void *arg);
+
+/*
+ * Removes the callback, waiting for it to finish if it is running in
+ * another thread. A callback must not unregister itself.
+ */
+EVO_THREADS_API
+void
+cancel_unregister(cancel_token_t, cancel_callback_t *cb);
+
+/*
+ * As cnd_wait(), or thrd_cancelled with the mutex held once the token
+ * fires; cancel_request() may be called with that mutex locked.
+ */
+EVO_THREADS_API
+int
+cnd_wait_cancellable(cnd_t *, mtx_t *__mtx, cancel_token_t);
+
+EVO_THREADS_API
+int
+cnd_timedwait_cancellable(cnd_t *__restrict, mtx_t *__restrict __mtx,
+                          const struct timespec *__restrict, cancel_token_t);
+
+/* As thrd_sleep(); returns -1 with `remaining` filled when cancelled */
+EVO_THREADS_API
+int
+thrd_sleep_cancellable(const struct timespec *, struct timespec *, cancel_token_t);
+
+/* thrd_sleep_until() that returns thrd_cancelled when the token fires */
+EVO_THREADS_API
+int
+thrd_sleep_until_cancellable(const struct timespec *, cancel_token_t);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_THREADS_CANCEL_H_DEFINED */
@@ -0,0 +1,107 @@
+#ifndef EVO_THREADS_GROUP_H_DEFINED
+#define EVO_THREADS_GROUP_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <evo/threads/threads.h>
+#include <evo/threads/notify.h>
+
+#include <stddef.h>
+
+/*---------------------------- types ----------------------------*/
+
+struct thrd_group_node;
+
+/*
+ * Set of threads joined in completion order. Members are started with
+ * thrd_group_create() and report their exit (return or thrd_exit) to the
+ * group, so thrd_group_join_any() picks whichever finished first.
+ */
+typedef struct {
+  mtx_t mtx;
+  cnd_t cnd;
+  struct thrd_group_node *head; /* finished, not joined yet (FIFO) */
+  struct thrd_group_node *tail;
+  size_t count;                 /* members not joined yet */
+  size_t running;               /* members not finished yet */
+  size_t limit;                 /* bound on `running`, 0 for none */
+  notifier_t *notifier;         /* signalled when a member finishes */
+} thrd_group_t;
+
+/*-------------------------- functions --------------------------*/
+
+EVO_THREADS_API
+int
+thrd_group_init(thrd_group_t *);
+
+/* All members must have been joined */
+EVO_THREADS_API
+void
+thrd_group_destroy(thrd_group_t *);
+
+/*
+ * Bounds the number of members running at once, 0 for no bound. Creating
+ * a member beyond it waits for a running one to finish.
+ */
+EVO_THREADS_API
+void
+thrd_group_setlimit(thrd_group_t *, size_t limit);
+
+/*
+ * Signals `notifier` (NULL for none) whenever a member finishes, for an
+ * event loop that calls thrd_group_join_any() once it is woken
+ */
+EVO_THREADS_API
+void
+thrd_group_setnotifier(thrd_group_t *, notifier_t *notifier);
+
+/* thrd_create() that makes the new thread a member of the group */
+EVO_THREADS_API
+int
+thrd_group_create(thrd_group_t *, thrd_t *, thrd_start_t, void *);
+
+/* thrd_group_create() failing with thrd_busy rather than waiting */
+EVO_THREADS_API
+int
+thrd_group_trycreate(thrd_group_t *, thrd_t *, thrd_start_t, void *);
+
+/* thrd_group_create() giving up with thrd_timedout at the TIME_UTC deadline */
+EVO_THREADS_API
+int
+thrd_group_create_until(thrd_group_t *, thrd_t *, thrd_start_t, void *,
+                        const struct timespec *__restrict);
+
+/*
+ * thrd_group_create() that runs func(arg) on the calling thread instead
+ * of waiting when the group is at its limit; returns thrd_busy then,
+ * with the result in `res`, which slows the producer down to the pace
+ * of the members.
+ */
+EVO_THREADS_API
+int
+thrd_group_create_or_run(thrd_group_t *, thrd_t *, thrd_start_t, void *, int *res);
+
+/* Joins a member that has finished already, thrd_busy if none has */
+EVO_THREADS_API
+int
+thrd_group_tryjoin_any(thrd_group_t *, thrd_t *, int *);
+
+/* Joins the first member to finish; thrd_error if the group is empty */
+EVO_THREADS_API
+int
+thrd_group_join_any(thrd_group_t *, thrd_t *, int *);
+
+/* Joins every member; thrd_error if any join failed */
+EVO_THREADS_API
+int
+thrd_group_join_all(thrd_group_t *);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_THREADS_GROUP_H_DEFINED */
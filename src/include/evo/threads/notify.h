@@ -0,0 +1,75 @@
+#ifndef EVO_THREADS_NOTIFY_H_DEFINED
+#define EVO_THREADS_NOTIFY_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <evo/threads/threads.h>
+
+#include <stdint.h>
+
+/*---------------------------- types ----------------------------*/
+
+/*
+ * Wakeup for event loops: a kernel object that becomes ready when the
+ * notifier is signalled, so a thread sleeping in epoll/poll (or
+ * WaitForMultipleObjects) also wakes for in-process events.
+ *
+ * Signals coalesce: only the first one after a drain touches the kernel
+ * object, however many follow. The consumer drains first and then looks
+ * at what it watches, so a signal racing with the drain is never lost.
+ */
+typedef struct {
+  uint32_t pending; /* signalled, not drained yet */
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  void *event;      /* manual-reset event HANDLE */
+#else
+  int fd;           /* eventfd, or the read end of a pipe */
+  int wfd;          /* same as fd for an eventfd */
+#endif
+} notifier_t;
+
+/*-------------------------- functions --------------------------*/
+
+EVO_THREADS_API
+int
+notifier_init(notifier_t *);
+
+EVO_THREADS_API
+void
+notifier_destroy(notifier_t *);
+
+/*
+ * The object to wait on: a non-blocking file descriptor that polls
+ * readable, or on Windows an event HANDLE.
+ */
+EVO_THREADS_API
+intptr_t
+notifier_native_handle(const notifier_t *);
+
+/* Makes the native handle ready; cheap while it already is */
+EVO_THREADS_API
+void
+notifier_signal(notifier_t *);
+
+/*
+ * notifier_signal() shaped as a callback, for cancel_register() and
+ * async continuations
+ */
+EVO_THREADS_API
+void
+notifier_callback(void *notifier);
+
+/* Clears the ready state; returns whether it was signalled */
+EVO_THREADS_API
+int
+notifier_drain(notifier_t *);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_THREADS_NOTIFY_H_DEFINED */
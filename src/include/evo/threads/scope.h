@@ -0,0 +1,72 @@
+#ifndef EVO_THREADS_SCOPE_H_DEFINED
+#define EVO_THREADS_SCOPE_H_DEFINED 1
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <evo/threads/cancel.h>
+#include <evo/threads/group.h>
+
+#include <stdint.h>
+
+/*---------------------------- types ----------------------------*/
+
+/*
+ * Structured concurrency: every thread spawned into a scope is joined by
+ * thrd_scope_close(), so none outlives the code that opened the scope.
+ * A child returning non-zero, or an explicit thrd_scope_cancel(), cancels
+ * the scope and all scopes nested in it; children are expected to poll
+ * thrd_scope_cancelled(), or to pass thrd_scope_token() to the
+ * cancellable waits, and return early.
+ */
+typedef struct thrd_scope {
+  thrd_group_t group;
+  cancel_source_t cancel;
+  const struct thrd_scope *parent;
+  cancel_callback_t parent_cb;  /* forwards the parent's cancellation */
+  int32_t status;               /* first non-zero child result */
+} thrd_scope_t;
+
+/*-------------------------- functions --------------------------*/
+
+/* `parent` may be NULL; a nested scope is cancelled with its parent */
+EVO_THREADS_API
+int
+thrd_scope_open(thrd_scope_t *, const thrd_scope_t *parent);
+
+/* Starts a child thread; thrd_error once the scope is cancelled */
+EVO_THREADS_API
+int
+thrd_scope_spawn(thrd_scope_t *, thrd_start_t, void *);
+
+EVO_THREADS_API
+void
+thrd_scope_cancel(thrd_scope_t *);
+
+static inline cancel_token_t
+thrd_scope_token(const thrd_scope_t *scope) {
+  return cancel_source_token(&scope->cancel);
+}
+
+/* A single relaxed load, cheap enough for inner loops */
+static inline int
+thrd_scope_cancelled(const thrd_scope_t *scope) {
+  return cancel_requested(thrd_scope_token(scope));
+}
+
+/*
+ * Waits for every child and releases the scope. `res` receives the first
+ * non-zero child result, or 0 when all succeeded.
+ */
+EVO_THREADS_API
+int
+thrd_scope_close(thrd_scope_t *, int *res);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* EVO_THREADS_SCOPE_H_DEFINED */
@@ -8,9 +8,11 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include <evo/threads/time.h>
+#include <evo/threads/exports.h>
 
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
@@ -24,6 +26,11 @@ extern "C" {
 #endif
 
 #if defined(HAVE_THRD_CREATE)
+/*
+ * Passthrough mode: the C library provides C11 threads natively, so the
+ * standard API comes straight from <threads.h> and only the extensions
+ * declared at the end of this header are implemented by the library.
+ */
 #include <threads.h>
 
 #if defined(ANDROID)
@@ -32,6 +39,16 @@ extern "C" {
  * FIXME: temporary non-standard hack to ease transition
  */
 #  define _MTX_INITIALIZER_NP PTHREAD_MUTEX_INITIALIZER
+/* bionic's mtx_t and cnd_t are pthread_mutex_t and pthread_cond_t as well */
+#  define _MTX_TIMED_INITIALIZER_NP PTHREAD_MUTEX_INITIALIZER
+#  define _CND_INITIALIZER_NP PTHREAD_COND_INITIALIZER
+#elif defined(__GLIBC__) || defined(__linux__)
+/* glibc and musl wrap a pthread_mutex_t in mtx_t, and a plain (non-recursive)
+ * mutex in its default state is all-zero bits on both of them.
+ */
+#  define _MTX_INITIALIZER_NP {0}
+#  define _MTX_TIMED_INITIALIZER_NP {0}
+#  define _CND_INITIALIZER_NP {0}
 #else
 #error Can not define _MTX_INITIALIZER_NP properly for this platform
 #endif
@@ -61,8 +78,6 @@ extern "C" {
 #  endif
 #endif
 
-#include <evo/threads/exports.h>
-
 /*---------------------------- types ----------------------------*/
 typedef void (*tss_dtor_t)(void *);
 typedef int (*thrd_start_t)(void *);
@@ -90,6 +105,11 @@ typedef struct {
 
 // FIXME: temporary non-standard hack to ease transition
 #  define _MTX_INITIALIZER_NP {(void*)-1, -1, 0, 0, 0, 0}
+/* A critical section is always recursive and supports the emulated timedlock */
+#  define _MTX_TIMED_INITIALIZER_NP _MTX_INITIALIZER_NP
+#  define _MTX_RECURSIVE_INITIALIZER_NP _MTX_INITIALIZER_NP
+#  define _MTX_TIMED_RECURSIVE_INITIALIZER_NP _MTX_INITIALIZER_NP
+#  define _CND_INITIALIZER_NP {0} /* CONDITION_VARIABLE_INIT */
 #  define ONCE_FLAG_INIT {0}
 #  define TSS_DTOR_ITERATIONS 1
 #elif defined(HAVE_PTHREAD)
@@ -100,6 +120,21 @@ typedef pthread_mutex_t mtx_t;
 typedef pthread_once_t  once_flag;
 // FIXME: temporary non-standard hack to ease transition
 #  define _MTX_INITIALIZER_NP PTHREAD_MUTEX_INITIALIZER
+/* Every pthread mutex accepts pthread_mutex_timedlock */
+#  define _MTX_TIMED_INITIALIZER_NP PTHREAD_MUTEX_INITIALIZER
+#  if defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP)
+#    define _MTX_RECURSIVE_INITIALIZER_NP PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#  elif defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER)
+#    define _MTX_RECURSIVE_INITIALIZER_NP PTHREAD_RECURSIVE_MUTEX_INITIALIZER
+#  elif defined(__GLIBC__) && defined(__PTHREAD_MUTEX_INITIALIZER)
+     /* glibc hides PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP behind _GNU_SOURCE */
+#    define _MTX_RECURSIVE_INITIALIZER_NP \
+       { { __PTHREAD_MUTEX_INITIALIZER (PTHREAD_MUTEX_RECURSIVE_NP) } }
+#  endif
+#  ifdef _MTX_RECURSIVE_INITIALIZER_NP
+#    define _MTX_TIMED_RECURSIVE_INITIALIZER_NP _MTX_RECURSIVE_INITIALIZER_NP
+#  endif
+#  define _CND_INITIALIZER_NP PTHREAD_COND_INITIALIZER
 #  define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
 #  ifdef INIT_ONCE_STATIC_INIT
 #    define TSS_DTOR_ITERATIONS PTHREAD_DESTRUCTOR_ITERATIONS
@@ -235,10 +270,279 @@ EVO_THREADS_API
 int
 tss_set(tss_t, void *);
 
+#endif /* !HAVE_THRD_CREATE */
+
+/*------------------------- extensions --------------------------*/
+
+/* Status codes of the extensions, clear of every C11 thrd_* value */
+enum {
+  thrd_cancelled = 0x100, // cancellation token fired first
+  thrd_noperm             // lacks the privilege for the request
+};
+
+/* Scheduling classes of thrd_setsched() */
+enum {
+  thrd_sched_other = 0, // default time-sharing
+  thrd_sched_fifo,      // real-time, run until blocked or preempted
+  thrd_sched_rr,        // real-time, round-robin
+  thrd_sched_batch,     // time-sharing, CPU-bound, fewer wakeup preemptions
+  thrd_sched_idle       // runs only when nothing else wants the CPU
+};
+
+/* NUMA memory policies of thrd_attr_t and thrd_setmempolicy() */
+enum {
+  thrd_mempolicy_default = 0, // allocate on the node of the touching CPU
+  thrd_mempolicy_bind,        // allocate only on the given nodes
+  thrd_mempolicy_preferred,   // first of the given nodes, others when full
+  thrd_mempolicy_interleave   // round-robin over the given nodes, by page
+};
+
+/* Wait policies of thrd_setwaitpolicy() */
+enum {
+  thrd_wait_block = 0, // sleep in the kernel right away
+  thrd_wait_poll,      // spin with pause instructions, never sleep
+  thrd_wait_hybrid     // spin for a while, then sleep
+};
+
+/* Levels of thrd_cpuset_near(), from the closest CPUs outwards */
+enum {
+  thrd_near_core = 0, // SMT siblings, sharing one core
+  thrd_near_cache,    // sharing the last-level cache
+  thrd_near_node      // on the same NUMA node
+};
+
+/* CPU numbers 0 .. THRD_CPUSET_SIZE - 1; zero-initialise for the empty set */
+#define THRD_CPUSET_SIZE 1024
+
+typedef struct {
+  uint64_t bits[THRD_CPUSET_SIZE / 64];
+} thrd_cpuset_t;
+
+#define THRD_CPU_SET(cpu, set)   ((set)->bits[(cpu) / 64] |= (uint64_t)1 << ((cpu) % 64))
+#define THRD_CPU_CLR(cpu, set)   ((set)->bits[(cpu) / 64] &= ~((uint64_t)1 << ((cpu) % 64)))
+#define THRD_CPU_ISSET(cpu, set) ((int)(((set)->bits[(cpu) / 64] >> ((cpu) % 64)) & 1))
+
+/* Flags of thrd_stack_pool_init() */
+enum {
+  thrd_stack_hugepages = 1, // back the stacks with transparent huge pages
+  thrd_stack_prefault = 2   // fault every page in when a stack is mapped
+};
+
+/*
+ * Pool of ready-made thread stacks, each with an inaccessible guard page
+ * below it. A stack goes back to the pool when its thread is joined, or,
+ * for a detached thread, once it has exited and the next thread is
+ * created from the pool. Needs the emulated C11 threads: the joins of
+ * native ones go unseen, so there thrd_stack_pool_init() fails.
+ */
+typedef struct {
+  mtx_t mtx;
+  void *free;        // recycled stacks
+  size_t stack_size; // usable bytes of each stack
+  size_t guard_size; // inaccessible bytes below each stack
+  int flags;         // thrd_stack_*
+} thrd_stack_pool_t;
+
+/*
+ * Maps `count` stacks of at least `stack_size` bytes up front; more are
+ * mapped on demand. thrd_error where threads can't be given a stack.
+ */
+EVO_THREADS_API
+int
+thrd_stack_pool_init(thrd_stack_pool_t *, size_t stack_size, size_t count, int flags);
+
+/*
+ * Unmaps the pooled stacks, waiting for the detached threads still on
+ * one of them; the stack of a thread not joined yet is unmapped when it
+ * is.
+ */
+EVO_THREADS_API
+void
+thrd_stack_pool_destroy(thrd_stack_pool_t *);
+
+/* Creation attributes of thrd_create_ex(), set up by thrd_attr_init() */
+typedef struct {
+  size_t stack_size;             // bytes, 0 for the platform default
+  int mempolicy;                 // thrd_mempolicy_*
+  uint64_t mempolicy_nodes;      // bit n selects NUMA node n
+  thrd_stack_pool_t *stack_pool; // source of the stack, or NULL
+  const thrd_cpuset_t *affinity; // CPUs to run on, NULL for any
+} thrd_attr_t;
+
+EVO_THREADS_API
+void
+thrd_attr_init(thrd_attr_t *);
+
+/*
+ * thrd_create() with attributes; `attr` may be NULL. The memory policy
+ * is in force before `func` runs, so the thread's stack and everything
+ * it first-touches land on the requested nodes.
+ */
+EVO_THREADS_API
+int
+thrd_create_ex(thrd_t *, const thrd_attr_t *, thrd_start_t, void *);
+
+/*
+ * Sets the NUMA memory policy of the calling thread for the pages it
+ * touches from now on. thrd_error where the system has no such policy.
+ */
+EVO_THREADS_API
+int
+thrd_setmempolicy(int policy, uint64_t nodes);
+
+/*
+ * Faults in every page of [addr, addr + len) by touching it, keeping
+ * the contents, from a helper thread bound to NUMA `node`, or from the
+ * calling thread (and so under its policy) when `node` is negative.
+ */
+EVO_THREADS_API
+int
+thrd_first_touch(void *addr, size_t len, int node);
+
+/* CPUs `thr` may run on; thrd_noperm without the right to move it */
+EVO_THREADS_API
+int
+thrd_setaffinity(thrd_t, const thrd_cpuset_t *);
+
+EVO_THREADS_API
+int
+thrd_getaffinity(thrd_t, thrd_cpuset_t *);
+
+/* CPU the calling thread is running on right now, -1 if unknown */
+EVO_THREADS_API
+int
+thrd_getcpu(void);
+
+/*
+ * CPUs close to `cpu` at `level` (thrd_near_*), `cpu` included, as the
+ * system topology describes them; for placing related threads together
+ * and picking whom to steal work from first.
+ */
+EVO_THREADS_API
+int
+thrd_cpuset_near(int cpu, int level, thrd_cpuset_t *);
+
+/* Joins `thr` if it has already finished, thrd_busy otherwise */
+EVO_THREADS_API
+int
+thrd_tryjoin(thrd_t, int *);
+
+/* Joins `thr`, giving up with thrd_timedout at the TIME_UTC deadline */
+EVO_THREADS_API
+int
+thrd_join_until(thrd_t, int *, const struct timespec *__restrict);
+
+/*
+ * Sleeps until the TIME_UTC deadline, resuming after signals. Advancing
+ * the deadline by a fixed period each round gives a periodic loop that
+ * does not drift, however long the work in between takes.
+ */
+EVO_THREADS_API
+int
+thrd_sleep_until(const struct timespec *);
+
+/*
+ * Blocks the calling thread until a permit from thrd_unpark() is
+ * available and consumes it. A thread holds at most one permit, so an
+ * unpark that comes first makes the next park return immediately.
+ */
+EVO_THREADS_API
+void
+thrd_park(void);
+
+/*
+ * thrd_park() giving up with thrd_timedout at the TIME_UTC deadline;
+ * thrd_error for a malformed one
+ */
+EVO_THREADS_API
+int
+thrd_park_until(const struct timespec *);
+
+/*
+ * Makes a permit available to `thr`, waking it if it is parked; takes no
+ * lock. `thr` must be running and known to the library: started by
+ * thrd_create_ex() or the emulated thrd_create(), the creator of such a
+ * thread, or any thread that called into the library before. thrd_error
+ * otherwise, including once `thr` has exited.
+ */
+EVO_THREADS_API
+int
+thrd_unpark(thrd_t);
+
+/*
+ * How the calling thread waits for a permit in thrd_park() and
+ * thrd_park_until(): thrd_wait_poll burns its CPU to skip the kernel
+ * wakeup latency, which pays off on isolated cores only, and
+ * thrd_wait_hybrid polls for `spin_nsec` before sleeping. An unpark
+ * reaches a polling thread without a system call. Only parking follows
+ * the policy: the waits of groups, scopes, cancellation and the
+ * cancellable sleeps always block on a condition variable.
+ */
+EVO_THREADS_API
+int
+thrd_setwaitpolicy(int policy, long spin_nsec);
+
+EVO_THREADS_API
+void
+thrd_getwaitpolicy(int *policy, long *spin_nsec);
+
+/*
+ * Small dense index of the calling thread, for array-indexed per-thread
+ * data. Assigned by thrd_create_ex() (and the emulated thrd_create())
+ * or on the thread's first call into the library, and handed to a new thread once it
+ * exits; always below thrd_index_max().
+ */
+EVO_THREADS_API
+int
+thrd_index(void);
+
+/* Exclusive upper bound of every index handed out so far; only grows */
+EVO_THREADS_API
+int
+thrd_index_max(void);
+
+/*
+ * Scheduling class (thrd_sched_*) and its static priority, which must be
+ * 0 for the non real-time classes. Raising either without the privilege
+ * to do so fails with thrd_noperm.
+ */
+EVO_THREADS_API
+int
+thrd_setsched(thrd_t, int policy, int priority);
+
+EVO_THREADS_API
+int
+thrd_getsched(thrd_t, int *policy, int *priority);
+
+/*
+ * Per-thread nice value (-20 .. 19) of the time-sharing classes.
+ *
+ * On Linux a thread other than the caller must have been started by
+ * thrd_create_ex() or the emulated thrd_create() and be running, or have
+ * called into the library before, unless the C library provides
+ * pthread_gettid_np().
+ */
+EVO_THREADS_API
+int
+thrd_setnice(thrd_t, int nice);
+
+EVO_THREADS_API
+int
+thrd_getnice(thrd_t, int *nice);
+
+/*
+ * Latency hint of a time-sharing thread: the time slice it asks for, in
+ * nanoseconds, 0 for the default. A shorter slice gets the thread
+ * scheduled sooner after wakeup. Honoured by Linux 6.12 and later (EEVDF
+ * custom slices), which clamps it to 0.1 .. 100 ms; thrd_error where the
+ * kernel has no such hint, told by reading the slice back.
+ */
+EVO_THREADS_API
+int
+thrd_setlatency_hint(thrd_t, long slice_nsec);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
 
-#endif /* !HAVE_THRD_CREATE */
-
 #endif /* EVO_THREADS_EMULATION_H_DEFINED */
@@ -0,0 +1,316 @@
+#ifndef EVO_THREADS_EMULATION_HPP_DEFINED
+#define EVO_THREADS_EMULATION_HPP_DEFINED 1
+
+#pragma once
+
+/*
+ * Optional C++11 layer over the C API. Everything is header-only and
+ * inline: the wrappers own nothing but the C object itself and satisfy
+ * the standard BasicLockable / Lockable / TimedLockable requirements, so
+ * std::lock_guard, std::unique_lock and std::scoped_lock work unchanged.
+ */
+
+#include <evo/threads/threads.h>
+#include <evo/threads/atomic.h>
+
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+
+namespace evo {
+namespace threads {
+
+namespace detail {
+
+inline void
+throw_on_error(int rc, const char *what) {
+  switch (rc) {
+  case thrd_success:
+    return;
+  case thrd_nomem:
+    throw std::system_error(std::make_error_code(std::errc::not_enough_memory), what);
+  case thrd_busy:
+    throw std::system_error(std::make_error_code(std::errc::device_or_resource_busy), what);
+  default:
+    throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again), what);
+  }
+}
+
+template <class Clock, class Duration>
+inline struct timespec
+to_timespec(const std::chrono::time_point<Clock, Duration> &abs_time) {
+  using namespace std::chrono;
+  /* The C API takes TIME_UTC deadlines, i.e. system_clock time points */
+  const auto utc = time_point_cast<nanoseconds>(
+    system_clock::now() + (abs_time - Clock::now()));
+  const auto ns = utc.time_since_epoch().count();
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+  ts.tv_nsec = static_cast<long>(ns % 1000000000);
+  if (ts.tv_nsec < 0) {
+    ts.tv_sec -= 1;
+    ts.tv_nsec += 1000000000;
+  }
+  return ts;
+}
+
+} /* namespace detail */
+
+/*---------------------------- mtx_t ----------------------------*/
+
+/* Non-owning view of an existing mtx_t, e.g. one set up with _MTX_INITIALIZER_NP */
+class mutex_ref {
+public:
+  explicit mutex_ref(mtx_t &mtx) noexcept : mtx_(&mtx) {}
+
+  void
+  lock() {
+    detail::throw_on_error(mtx_lock(mtx_), "mtx_lock");
+  }
+
+  bool
+  try_lock() noexcept {
+    return mtx_trylock(mtx_) == thrd_success;
+  }
+
+  /* Requires a mutex created with mtx_timed */
+  template <class Clock, class Duration>
+  bool
+  try_lock_until(const std::chrono::time_point<Clock, Duration> &abs_time) {
+    const struct timespec ts = detail::to_timespec(abs_time);
+    const int rc = mtx_timedlock(mtx_, &ts);
+    if (rc == thrd_timedout)
+      return false;
+    detail::throw_on_error(rc, "mtx_timedlock");
+    return true;
+  }
+
+  template <class Rep, class Period>
+  bool
+  try_lock_for(const std::chrono::duration<Rep, Period> &rel_time) {
+    return try_lock_until(std::chrono::steady_clock::now() + rel_time);
+  }
+
+  void
+  unlock() noexcept {
+    mtx_unlock(mtx_);
+  }
+
+  mtx_t *
+  native_handle() const noexcept {
+    return mtx_;
+  }
+
+private:
+  mtx_t *mtx_;
+};
+
+/* Owning mtx_t; `type` is any mtx_init type (mtx_plain, mtx_timed|mtx_recursive, ...) */
+class mutex {
+public:
+  explicit mutex(int type = mtx_plain) {
+    detail::throw_on_error(mtx_init(&mtx_, type), "mtx_init");
+  }
+
+  ~mutex() {
+    mtx_destroy(&mtx_);
+  }
+
+  mutex(const mutex &) = delete;
+  mutex &operator=(const mutex &) = delete;
+
+  void
+  lock() {
+    mutex_ref(mtx_).lock();
+  }
+
+  bool
+  try_lock() noexcept {
+    return mtx_trylock(&mtx_) == thrd_success;
+  }
+
+  template <class Clock, class Duration>
+  bool
+  try_lock_until(const std::chrono::time_point<Clock, Duration> &abs_time) {
+    return mutex_ref(mtx_).try_lock_until(abs_time);
+  }
+
+  template <class Rep, class Period>
+  bool
+  try_lock_for(const std::chrono::duration<Rep, Period> &rel_time) {
+    return mutex_ref(mtx_).try_lock_for(rel_time);
+  }
+
+  void
+  unlock() noexcept {
+    mtx_unlock(&mtx_);
+  }
+
+  mtx_t *
+  native_handle() noexcept {
+    return &mtx_;
+  }
+
+private:
+  mtx_t mtx_;
+};
+
+class timed_mutex : public mutex {
+public:
+  timed_mutex() : mutex(mtx_timed) {}
+};
+
+class recursive_mutex : public mutex {
+public:
+  recursive_mutex() : mutex(mtx_plain | mtx_recursive) {}
+};
+
+class recursive_timed_mutex : public mutex {
+public:
+  recursive_timed_mutex() : mutex(mtx_timed | mtx_recursive) {}
+};
+
+/*------------------------ lock policies ------------------------*/
+
+/*
+ * A policy is a stateless struct with a `state` type and static init,
+ * destroy, lock, try_lock and unlock functions over it. basic_lock picks
+ * one at compile time, so call sites pay for no runtime dispatch.
+ */
+
+/* Test-and-test-and-set spinlock; never sleeps */
+struct spin_policy {
+  struct state {
+    uint32_t locked;
+  };
+
+  static void init(state &s) noexcept { s.locked = 0; }
+  static void destroy(state &) noexcept {}
+
+  static bool
+  try_lock(state &s) noexcept {
+    return evo_atomic_load_u32(&s.locked, EVO_ATOMIC_RELAXED) == 0
+        && evo_atomic_exchange_u32(&s.locked, 1, EVO_ATOMIC_ACQUIRE) == 0;
+  }
+
+  static void
+  lock(state &s) noexcept {
+    while (evo_atomic_exchange_u32(&s.locked, 1, EVO_ATOMIC_ACQUIRE) != 0) {
+      while (evo_atomic_load_u32(&s.locked, EVO_ATOMIC_RELAXED) != 0)
+        evo_cpu_relax();
+    }
+  }
+
+  static void
+  unlock(state &s) noexcept {
+    evo_atomic_store_u32(&s.locked, 0, EVO_ATOMIC_RELEASE);
+  }
+};
+
+/* Blocking mtx_t: the kernel-assisted (futex on Linux) path */
+struct futex_policy {
+  struct state {
+    mtx_t mtx;
+  };
+
+  static void
+  init(state &s) {
+    detail::throw_on_error(mtx_init(&s.mtx, mtx_plain), "mtx_init");
+  }
+
+  static void destroy(state &s) noexcept { mtx_destroy(&s.mtx); }
+
+  static bool
+  try_lock(state &s) noexcept {
+    return mtx_trylock(&s.mtx) == thrd_success;
+  }
+
+  static void
+  lock(state &s) {
+    detail::throw_on_error(mtx_lock(&s.mtx), "mtx_lock");
+  }
+
+  static void unlock(state &s) noexcept { mtx_unlock(&s.mtx); }
+};
+
+/* Spins up to `Spins` attempts before blocking in mtx_lock */
+template <unsigned Spins = 100>
+struct adaptive_policy : futex_policy {
+  static void
+  lock(state &s) {
+    for (unsigned i = 0; i < Spins; ++i) {
+      if (mtx_trylock(&s.mtx) == thrd_success)
+        return;
+      evo_cpu_relax();
+    }
+    futex_policy::lock(s);
+  }
+};
+
+/* FIFO ticket lock: waiters acquire in arrival order */
+struct fair_policy {
+  struct state {
+    uint32_t next;
+    uint32_t serving;
+  };
+
+  static void init(state &s) noexcept { s.next = s.serving = 0; }
+  static void destroy(state &) noexcept {}
+
+  static bool
+  try_lock(state &s) noexcept {
+    /* Acquire: unlock() publishes through `serving`, never through `next` */
+    uint32_t serving = evo_atomic_load_u32(&s.serving, EVO_ATOMIC_ACQUIRE);
+    uint32_t expected = serving;
+    return evo_atomic_cas_u32(&s.next, &expected, serving + 1, EVO_ATOMIC_ACQUIRE) != 0;
+  }
+
+  static void
+  lock(state &s) noexcept {
+    const uint32_t ticket = evo_atomic_fetch_add_u32(&s.next, 1, EVO_ATOMIC_RELAXED);
+    unsigned spins = 0;
+    while (evo_atomic_load_u32(&s.serving, EVO_ATOMIC_ACQUIRE) != ticket) {
+      if (++spins < 1024) {
+        evo_cpu_relax();
+      } else {
+        /* Likely oversubscribed: let the owner run */
+        thrd_yield();
+      }
+    }
+  }
+
+  static void
+  unlock(state &s) noexcept {
+    const uint32_t serving = evo_atomic_load_u32(&s.serving, EVO_ATOMIC_RELAXED);
+    evo_atomic_store_u32(&s.serving, serving + 1, EVO_ATOMIC_RELEASE);
+  }
+};
+
+template <class Policy>
+class basic_lock {
+public:
+  using policy_type = Policy;
+
+  basic_lock() { Policy::init(state_); }
+  ~basic_lock() { Policy::destroy(state_); }
+
+  basic_lock(const basic_lock &) = delete;
+  basic_lock &operator=(const basic_lock &) = delete;
+
+  void lock() { Policy::lock(state_); }
+  bool try_lock() noexcept { return Policy::try_lock(state_); }
+  void unlock() noexcept { Policy::unlock(state_); }
+
+private:
+  typename Policy::state state_;
+};
+
+using spin_lock = basic_lock<spin_policy>;
+using adaptive_lock = basic_lock<adaptive_policy<> >;
+using futex_lock = basic_lock<futex_policy>;
+using fair_lock = basic_lock<fair_policy>;
+
+} /* namespace threads */
+} /* namespace evo */
+
+#endif /* EVO_THREADS_EMULATION_HPP_DEFINED */
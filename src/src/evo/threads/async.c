@@ -0,0 +1,123 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include <evo/threads/async.h>
+
+/*
+ * Continuations run on the calling thread go through a per-thread run
+ * list, so one that releases or acquires again queues the next one
+ * behind itself instead of nesting it: a chain of hand-overs takes
+ * constant stack.
+ */
+
+struct impl_async_run {
+  async_waiter_t *head;
+  async_waiter_t *tail;
+  int active;
+};
+
+static _Thread_local struct impl_async_run impl_async_run;
+
+static void
+impl_async_run_here(async_waiter_t *w) {
+  struct impl_async_run *run = &impl_async_run;
+  w->next = NULL;
+  if (run->tail)
+    run->tail->next = w;
+  else
+    run->head = w;
+  run->tail = w;
+  if (run->active)
+    return;
+  run->active = 1;
+  while ((w = run->head) != NULL) {
+    void (*func)(void *) = w->func;
+    void *arg = w->arg;
+    // `w` belongs to the caller again once func starts
+    run->head = w->next;
+    if (!run->head)
+      run->tail = NULL;
+    func(arg);
+  }
+  run->active = 0;
+}
+
+
+int
+async_sem_init(async_sem_t *sem, unsigned count, async_post_t post, void *ctx) {
+  assert(sem != NULL);
+  if (mtx_init(&sem->mtx, mtx_plain) != thrd_success)
+    return thrd_error;
+  sem->count = count;
+  sem->head = sem->tail = NULL;
+  sem->post = post;
+  sem->ctx = ctx;
+  return thrd_success;
+}
+
+void
+async_sem_destroy(async_sem_t *sem) {
+  assert(sem != NULL);
+  assert(sem->head == NULL);
+  mtx_destroy(&sem->mtx);
+}
+
+void
+async_sem_acquire(async_sem_t *sem, async_waiter_t *waiter, void (*func)(void *), void *arg) {
+  int granted;
+  assert(sem != NULL && waiter != NULL && func != NULL);
+  waiter->func = func;
+  waiter->arg = arg;
+  waiter->next = NULL;
+  mtx_lock(&sem->mtx);
+  // no barging past waiters: a free permit with waiters is theirs
+  granted = sem->count > 0 && !sem->head;
+  if (granted) {
+    sem->count--;
+  } else {
+    if (sem->tail)
+      sem->tail->next = waiter;
+    else
+      sem->head = waiter;
+    sem->tail = waiter;
+  }
+  mtx_unlock(&sem->mtx);
+  if (granted)
+    impl_async_run_here(waiter);
+}
+
+int
+async_sem_tryacquire(async_sem_t *sem) {
+  int rt = thrd_busy;
+  assert(sem != NULL);
+  mtx_lock(&sem->mtx);
+  if (sem->count > 0 && !sem->head) {
+    sem->count--;
+    rt = thrd_success;
+  }
+  mtx_unlock(&sem->mtx);
+  return rt;
+}
+
+void
+async_sem_release(async_sem_t *sem) {
+  async_waiter_t *next;
+  assert(sem != NULL);
+  mtx_lock(&sem->mtx);
+  next = sem->head;
+  if (next) {
+    sem->head = next->next;
+    if (!sem->head)
+      sem->tail = NULL;
+  } else {
+    sem->count++;
+  }
+  mtx_unlock(&sem->mtx);
+  if (!next)
+    return;
+  // the permit moves to `next` without ever being free
+  if (sem->post)
+    sem->post(sem->ctx, next->func, next->arg);
+  else
+    impl_async_run_here(next);
+}
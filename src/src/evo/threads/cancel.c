@@ -0,0 +1,261 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include <evo/threads/cancel.h>
+
+/*
+ * Callbacks run outside the source lock so they may take other locks;
+ * `running` lets cancel_unregister() wait for one that is in flight.
+ */
+
+/* Bound on one sleep of a cancellable cnd wait, doubled up to the max */
+#define IMPL_CANCEL_SLICE_MIN_NSEC 1000000L
+#define IMPL_CANCEL_SLICE_MAX_NSEC 128000000L
+
+struct impl_cnd_waker {
+  cnd_t *cond;
+  mtx_t *mtx;
+  uint32_t fired;
+};
+
+static void
+impl_timespec_add(struct timespec *ts, const struct timespec *d) {
+  ts->tv_sec += d->tv_sec;
+  ts->tv_nsec += d->tv_nsec;
+  if (ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec += 1;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+static int
+impl_timespec_before(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Runs in the thread that requests cancellation, which may hold the
+ * waiter's mutex itself: it is only tried, never waited for.
+ */
+static void
+impl_cnd_wake(void *p) {
+  struct impl_cnd_waker *waker = (struct impl_cnd_waker *)p;
+  evo_atomic_store_u32(&waker->fired, 1, EVO_ATOMIC_RELEASE);
+  if (mtx_trylock(waker->mtx) == thrd_success) {
+    // the waiter either checks the flag after this or already sleeps
+    cnd_broadcast(waker->cond);
+    mtx_unlock(waker->mtx);
+  } else {
+    // may land between the waiter's check and its sleep: the slice bounds that
+    cnd_broadcast(waker->cond);
+  }
+}
+
+static int
+impl_cnd_wait(cnd_t *cond, mtx_t *mtx, const struct timespec *abs_time,
+              cancel_token_t token) {
+  struct impl_cnd_waker waker;
+  cancel_callback_t cb;
+  long slice = IMPL_CANCEL_SLICE_MIN_NSEC;
+  int rt;
+
+  if (!token)
+    return abs_time ? cnd_timedwait(cond, mtx, abs_time) : cnd_wait(cond, mtx);
+
+  waker.cond = cond;
+  waker.mtx = mtx;
+  waker.fired = 0;
+  if (cancel_register(token, &cb, impl_cnd_wake, &waker) != thrd_success)
+    return thrd_cancelled;
+  for (;;) {
+    struct timespec until, step = {0, 0};
+    int last;
+    if (evo_atomic_load_u32(&waker.fired, EVO_ATOMIC_ACQUIRE)) {
+      rt = thrd_cancelled;
+      break;
+    }
+    step.tv_nsec = slice;
+    timespec_get(&until, TIME_UTC);
+    impl_timespec_add(&until, &step);
+    last = abs_time && !impl_timespec_before(&until, abs_time);
+    rt = cnd_timedwait(cond, mtx, last ? abs_time : &until);
+    if (rt != thrd_timedout || last)
+      break;
+    if (slice < IMPL_CANCEL_SLICE_MAX_NSEC)
+      slice *= 2;
+  }
+  cancel_unregister(token, &cb);
+  if (rt == thrd_success && cancel_requested(token))
+    return thrd_cancelled;
+  return rt;
+}
+
+int
+cancel_source_init(cancel_source_t *src) {
+  assert(src != NULL);
+  src->cancelled = 0;
+  src->callbacks = NULL;
+  src->running = NULL;
+  if (mtx_init(&src->mtx, mtx_plain) != thrd_success)
+    return thrd_error;
+  if (cnd_init(&src->cnd) != thrd_success) {
+    mtx_destroy(&src->mtx);
+    return thrd_error;
+  }
+  return thrd_success;
+}
+
+void
+cancel_source_destroy(cancel_source_t *src) {
+  assert(src != NULL);
+  assert(src->callbacks == NULL);
+  cnd_destroy(&src->cnd);
+  mtx_destroy(&src->mtx);
+}
+
+void
+cancel_request(cancel_source_t *src) {
+  cancel_callback_t *cb;
+  assert(src != NULL);
+  mtx_lock(&src->mtx);
+  if (src->cancelled) {
+    mtx_unlock(&src->mtx);
+    return;
+  }
+  evo_atomic_store_u32(&src->cancelled, 1, EVO_ATOMIC_RELEASE);
+  cnd_broadcast(&src->cnd);
+  while ((cb = src->callbacks) != NULL) {
+    src->callbacks = cb->next;
+    if (cb->next)
+      cb->next->prev = NULL;
+    cb->linked = 0;
+    src->running = cb;
+    mtx_unlock(&src->mtx);
+    cb->func(cb->arg);
+    mtx_lock(&src->mtx);
+    src->running = NULL;
+    cnd_broadcast(&src->cnd);
+  }
+  mtx_unlock(&src->mtx);
+}
+
+int
+cancel_register(cancel_token_t token, cancel_callback_t *cb,
+                void (*func)(void *), void *arg) {
+  cancel_source_t *src = (cancel_source_t *)token;
+  assert(cb != NULL && func != NULL);
+  cb->func = func;
+  cb->arg = arg;
+  cb->linked = 0;
+  if (!src)
+    return thrd_success;
+  mtx_lock(&src->mtx);
+  if (src->cancelled) {
+    mtx_unlock(&src->mtx);
+    return thrd_cancelled;
+  }
+  cb->prev = NULL;
+  cb->next = src->callbacks;
+  if (cb->next)
+    cb->next->prev = cb;
+  src->callbacks = cb;
+  cb->linked = 1;
+  mtx_unlock(&src->mtx);
+  return thrd_success;
+}
+
+void
+cancel_unregister(cancel_token_t token, cancel_callback_t *cb) {
+  cancel_source_t *src = (cancel_source_t *)token;
+  assert(cb != NULL);
+  if (!src)
+    return;
+  mtx_lock(&src->mtx);
+  if (cb->linked) {
+    if (cb->prev)
+      cb->prev->next = cb->next;
+    else
+      src->callbacks = cb->next;
+    if (cb->next)
+      cb->next->prev = cb->prev;
+    cb->linked = 0;
+  } else {
+    while (src->running == cb)
+      cnd_wait(&src->cnd, &src->mtx);
+  }
+  mtx_unlock(&src->mtx);
+}
+
+// thrd_success at the deadline, thrd_cancelled or thrd_error before it
+static int
+impl_sleep_until(cancel_source_t *src, const struct timespec *abs_time) {
+  int rt = thrd_success;
+  int cancelled;
+  mtx_lock(&src->mtx);
+  while (!(cancelled = (int)src->cancelled) && rt != thrd_timedout) {
+    rt = cnd_timedwait(&src->cnd, &src->mtx, abs_time);
+    if (rt == thrd_error)
+      break;
+  }
+  mtx_unlock(&src->mtx);
+  if (rt == thrd_error)
+    return thrd_error;
+  return cancelled ? thrd_cancelled : thrd_success;
+}
+
+int
+cnd_wait_cancellable(cnd_t *cond, mtx_t *mtx, cancel_token_t token) {
+  assert(cond != NULL);
+  assert(mtx != NULL);
+  return impl_cnd_wait(cond, mtx, NULL, token);
+}
+
+int
+cnd_timedwait_cancellable(cnd_t *cond, mtx_t *mtx,
+                          const struct timespec *abs_time, cancel_token_t token) {
+  assert(cond != NULL);
+  assert(mtx != NULL);
+  assert(abs_time != NULL);
+  return impl_cnd_wait(cond, mtx, abs_time, token);
+}
+
+int
+thrd_sleep_cancellable(const struct timespec *duration, struct timespec *remaining,
+                       cancel_token_t token) {
+  cancel_source_t *src = (cancel_source_t *)token;
+  struct timespec deadline;
+  int rt;
+
+  assert(duration != NULL);
+  if (!src)
+    return thrd_sleep(duration, remaining);
+
+  timespec_get(&deadline, TIME_UTC);
+  impl_timespec_add(&deadline, duration);
+  rt = impl_sleep_until(src, &deadline);
+  if (rt == thrd_error)
+    return -2;
+  if (rt == thrd_success)
+    return 0;
+  if (remaining) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    remaining->tv_sec = deadline.tv_sec - now.tv_sec;
+    remaining->tv_nsec = deadline.tv_nsec - now.tv_nsec;
+    if (remaining->tv_nsec < 0) {
+      remaining->tv_sec -= 1;
+      remaining->tv_nsec += 1000000000L;
+    }
+    if (remaining->tv_sec < 0)
+      remaining->tv_sec = remaining->tv_nsec = 0;
+  }
+  return -1;
+}
+
+int
+thrd_sleep_until_cancellable(const struct timespec *abs_time, cancel_token_t token) {
+  assert(abs_time != NULL);
+  if (!token)
+    return thrd_sleep_until(abs_time);
+  return impl_sleep_until((cancel_source_t *)token, abs_time);
+}
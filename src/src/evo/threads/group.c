@@ -0,0 +1,223 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <evo/threads/group.h>
+
+/*
+ * Members report completion from a TSS destructor rather than from the
+ * start routine, so a member leaving through thrd_exit() is seen as well.
+ * This works the same on every backend, including the native <threads.h>.
+ */
+
+struct thrd_group_node {
+  struct thrd_group_node *next;
+  thrd_group_t *group;
+  thrd_t thr;
+  thrd_start_t func;
+  void *arg;
+};
+
+static tss_t impl_group_key;
+static int impl_group_key_ok;
+static once_flag impl_group_once = ONCE_FLAG_INIT;
+
+static void
+impl_group_finished(void *p) {
+  struct thrd_group_node *node = (struct thrd_group_node *)p;
+  thrd_group_t *grp = node->group;
+  mtx_lock(&grp->mtx);
+  node->next = NULL;
+  if (grp->tail)
+    grp->tail->next = node;
+  else
+    grp->head = node;
+  grp->tail = node;
+  grp->running--;
+  cnd_broadcast(&grp->cnd);
+  if (grp->notifier)
+    notifier_signal(grp->notifier);
+  mtx_unlock(&grp->mtx);
+}
+
+static void
+impl_group_key_init(void) {
+  impl_group_key_ok = tss_create(&impl_group_key, impl_group_finished) == thrd_success;
+}
+
+static int
+impl_group_routine(void *p) {
+  struct thrd_group_node *node = (struct thrd_group_node *)p;
+  tss_set(impl_group_key, node);
+  return node->func(node->arg);
+}
+
+/* `wait`: 0 fails with thrd_busy at the limit, else waits until `abs_time` */
+static int
+impl_group_create(thrd_group_t *grp, thrd_t *thr, thrd_start_t func, void *arg,
+                  int wait, const struct timespec *abs_time) {
+  struct thrd_group_node *node;
+  int rt = thrd_success;
+  assert(grp != NULL);
+  node = (struct thrd_group_node *)malloc(sizeof(struct thrd_group_node));
+  if (!node)
+    return thrd_nomem;
+  node->group = grp;
+  node->func = func;
+  node->arg = arg;
+  // the member can't report completion before its handle is stored
+  mtx_lock(&grp->mtx);
+  while (rt == thrd_success && grp->limit && grp->running >= grp->limit) {
+    if (!wait)
+      rt = thrd_busy;
+    else if (abs_time)
+      rt = cnd_timedwait(&grp->cnd, &grp->mtx, abs_time);
+    else
+      rt = cnd_wait(&grp->cnd, &grp->mtx);
+  }
+  if (rt == thrd_success)
+    rt = thrd_create(&node->thr, impl_group_routine, node);
+  if (rt == thrd_success) {
+    grp->count++;
+    grp->running++;
+    if (thr)
+      *thr = node->thr;
+  }
+  mtx_unlock(&grp->mtx);
+  if (rt != thrd_success)
+    free(node);
+  return rt;
+}
+
+
+int
+thrd_group_init(thrd_group_t *grp) {
+  assert(grp != NULL);
+  call_once(&impl_group_once, impl_group_key_init);
+  if (!impl_group_key_ok)
+    return thrd_error;
+  if (mtx_init(&grp->mtx, mtx_plain) != thrd_success)
+    return thrd_error;
+  if (cnd_init(&grp->cnd) != thrd_success) {
+    mtx_destroy(&grp->mtx);
+    return thrd_error;
+  }
+  grp->head = grp->tail = NULL;
+  grp->count = 0;
+  grp->running = 0;
+  grp->limit = 0;
+  grp->notifier = NULL;
+  return thrd_success;
+}
+
+void
+thrd_group_destroy(thrd_group_t *grp) {
+  assert(grp != NULL);
+  assert(grp->count == 0);
+  cnd_destroy(&grp->cnd);
+  mtx_destroy(&grp->mtx);
+}
+
+void
+thrd_group_setlimit(thrd_group_t *grp, size_t limit) {
+  assert(grp != NULL);
+  mtx_lock(&grp->mtx);
+  grp->limit = limit;
+  cnd_broadcast(&grp->cnd);
+  mtx_unlock(&grp->mtx);
+}
+
+void
+thrd_group_setnotifier(thrd_group_t *grp, notifier_t *notifier) {
+  assert(grp != NULL);
+  mtx_lock(&grp->mtx);
+  grp->notifier = notifier;
+  // members that finished before still wait to be joined
+  if (notifier && grp->head)
+    notifier_signal(notifier);
+  mtx_unlock(&grp->mtx);
+}
+
+int
+thrd_group_create(thrd_group_t *grp, thrd_t *thr, thrd_start_t func, void *arg) {
+  return impl_group_create(grp, thr, func, arg, 1, NULL);
+}
+
+int
+thrd_group_trycreate(thrd_group_t *grp, thrd_t *thr, thrd_start_t func, void *arg) {
+  return impl_group_create(grp, thr, func, arg, 0, NULL);
+}
+
+int
+thrd_group_create_until(thrd_group_t *grp, thrd_t *thr, thrd_start_t func, void *arg,
+                        const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  return impl_group_create(grp, thr, func, arg, 1, abs_time);
+}
+
+int
+thrd_group_create_or_run(thrd_group_t *grp, thrd_t *thr, thrd_start_t func, void *arg,
+                         int *res) {
+  int rt = impl_group_create(grp, thr, func, arg, 0, NULL);
+  if (rt == thrd_busy) {
+    int code = func(arg);
+    if (res)
+      *res = code;
+  }
+  return rt;
+}
+
+static int
+impl_group_join(thrd_group_t *grp, thrd_t *thr, int *res, int wait) {
+  struct thrd_group_node *node;
+  thrd_t member;
+  assert(grp != NULL);
+  mtx_lock(&grp->mtx);
+  if (grp->count == 0) {
+    mtx_unlock(&grp->mtx);
+    return thrd_error;
+  }
+  while (wait && !grp->head)
+    cnd_wait(&grp->cnd, &grp->mtx);
+  node = grp->head;
+  if (!node) {
+    mtx_unlock(&grp->mtx);
+    return thrd_busy;
+  }
+  grp->head = node->next;
+  if (!grp->head)
+    grp->tail = NULL;
+  grp->count--;
+  mtx_unlock(&grp->mtx);
+
+  member = node->thr;
+  free(node);
+  if (thr)
+    *thr = member;
+  return thrd_join(member, res);
+}
+
+int
+thrd_group_tryjoin_any(thrd_group_t *grp, thrd_t *thr, int *res) {
+  return impl_group_join(grp, thr, res, 0);
+}
+
+int
+thrd_group_join_any(thrd_group_t *grp, thrd_t *thr, int *res) {
+  return impl_group_join(grp, thr, res, 1);
+}
+
+int
+thrd_group_join_all(thrd_group_t *grp) {
+  int rt = thrd_success;
+  assert(grp != NULL);
+  for (;;) {
+    size_t count;
+    mtx_lock(&grp->mtx);
+    count = grp->count;
+    mtx_unlock(&grp->mtx);
+    if (count == 0)
+      return rt;
+    if (thrd_group_join_any(grp, NULL, NULL) != thrd_success)
+      rt = thrd_error;
+  }
+}
@@ -0,0 +1,141 @@
+#include <assert.h>
+
+#include <evo/threads/notify.h>
+#include <evo/threads/atomic.h>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+
+int
+notifier_init(notifier_t *n) {
+  assert(n != NULL);
+  n->pending = 0;
+  n->event = CreateEventW(NULL, TRUE, FALSE, NULL);
+  return n->event ? thrd_success : thrd_error;
+}
+
+void
+notifier_destroy(notifier_t *n) {
+  assert(n != NULL);
+  CloseHandle((HANDLE)n->event);
+}
+
+intptr_t
+notifier_native_handle(const notifier_t *n) {
+  assert(n != NULL);
+  return (intptr_t)n->event;
+}
+
+static void
+impl_notifier_raise(notifier_t *n) {
+  SetEvent((HANDLE)n->event);
+}
+
+static void
+impl_notifier_lower(notifier_t *n) {
+  ResetEvent((HANDLE)n->event);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_EVENTFD_H)
+# include <sys/eventfd.h>
+#endif
+
+int
+notifier_init(notifier_t *n) {
+  assert(n != NULL);
+  n->pending = 0;
+#if defined(HAVE_SYS_EVENTFD_H)
+  n->fd = n->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return (n->fd >= 0) ? thrd_success : thrd_error;
+#else
+  {
+  int fds[2], i;
+  if (pipe(fds) != 0)
+    return thrd_error;
+  for (i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  n->fd = fds[0];
+  n->wfd = fds[1];
+  return thrd_success;
+  }
+#endif
+}
+
+void
+notifier_destroy(notifier_t *n) {
+  assert(n != NULL);
+  close(n->fd);
+  if (n->wfd != n->fd)
+    close(n->wfd);
+}
+
+intptr_t
+notifier_native_handle(const notifier_t *n) {
+  assert(n != NULL);
+  return n->fd;
+}
+
+static void
+impl_notifier_raise(notifier_t *n) {
+#if defined(HAVE_SYS_EVENTFD_H)
+  uint64_t one = 1;
+  while (write(n->wfd, &one, sizeof(one)) < 0 && errno == EINTR)
+    ;
+#else
+  char one = 1;
+  while (write(n->wfd, &one, 1) < 0 && errno == EINTR)
+    ;
+#endif
+}
+
+static void
+impl_notifier_lower(notifier_t *n) {
+  uint64_t buf[8];
+  // until EAGAIN: a pipe may hold more than one byte
+  for (;;) {
+    ssize_t rt = read(n->fd, buf, sizeof(buf));
+    if (rt < 0 && errno == EINTR)
+      continue;
+    if (rt <= 0)
+      break;
+  }
+}
+
+#endif
+
+void
+notifier_signal(notifier_t *n) {
+  assert(n != NULL);
+  if (evo_atomic_load_u32(&n->pending, EVO_ATOMIC_ACQUIRE))
+    return;
+  if (evo_atomic_exchange_u32(&n->pending, 1, EVO_ATOMIC_ACQ_REL) == 0)
+    impl_notifier_raise(n);
+}
+
+void
+notifier_callback(void *notifier) {
+  notifier_signal((notifier_t *)notifier);
+}
+
+int
+notifier_drain(notifier_t *n) {
+  assert(n != NULL);
+  /*
+   * Lowered before the flag is cleared: a signal after the exchange sees
+   * it clear and raises again. One that set the flag but raises only
+   * after the exchange leaves a spurious readiness, never a lost one.
+   */
+  impl_notifier_lower(n);
+  return evo_atomic_exchange_u32(&n->pending, 0, EVO_ATOMIC_ACQ_REL) != 0;
+}
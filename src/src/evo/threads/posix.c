@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* pthread_tryjoin_np, pthread_timedjoin_np */
+#endif
+
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
@@ -5,8 +9,62 @@
 #include <unistd.h>
 #include <sched.h>
 #include <stdint.h> /* for intptr_t */
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
 
 #include <evo/threads/threads.h>
+#include <evo/threads/atomic.h>
+
+#if defined(__linux__)
+# include <sys/resource.h>
+# include <sys/syscall.h>
+#endif
+#if defined(HAVE_LINUX_FUTEX_H)
+# include <linux/futex.h>
+#endif
+
+/*
+Configuration macro:
+
+  EMULATED_THREADS_USE_NATIVE_TRYJOIN
+    Implement thrd_tryjoin()/thrd_join_until() with the glibc/musl
+    pthread_tryjoin_np()/pthread_timedjoin_np(). Otherwise every thread
+    started by thrd_create() carries a completion event signalled on exit,
+    which requires the emulated thrd_create().
+
+  EMULATED_THREADS_USE_FUTEX
+    Park threads on a Linux futex word. Otherwise every thread state
+    carries a mutex and condition variable for thrd_park().
+
+  EMULATED_THREADS_STATE_BUCKETS
+    Number of independently locked buckets of the thrd_t -> thread state
+    table used by thrd_unpark().
+*/
+#if defined(HAVE_PTHREAD_TRYJOIN_NP) && defined(HAVE_PTHREAD_TIMEDJOIN_NP)
+# define EMULATED_THREADS_USE_NATIVE_TRYJOIN
+#endif
+#if defined(HAVE_THRD_CREATE) && !defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+# error Native C11 threads need pthread_tryjoin_np() and pthread_timedjoin_np()
+#endif
+#if defined(HAVE_LINUX_FUTEX_H) && (defined(SYS_futex) || defined(SYS_futex_time64))
+# define EMULATED_THREADS_USE_FUTEX
+# ifndef SYS_futex
+#   define SYS_futex SYS_futex_time64
+# endif
+#endif
+#define EMULATED_THREADS_STATE_BUCKETS 64
+
+#if defined(HAVE_THRD_CREATE)
+/*
+ * Native C11 threads: the standard functions come from the C library and
+ * only the extensions below are compiled. They rely on thrd_t being the
+ * pthread_t of the thread, which holds for glibc, musl and bionic.
+ */
+static_assert(sizeof(thrd_t) == sizeof(pthread_t), "The size of thrd_t must equal to pthread_t");
+#else
 
 #if !defined(__CYGWIN__) && !defined(__APPLE__) && !defined(__NetBSD__)
 # define EMULATED_THREADS_USE_NATIVE_TIMEDLOCK
@@ -18,19 +76,84 @@
 Implementation limits:
   - Conditionally emulation for "mutex with timeout"
     (see EMULATED_THREADS_USE_NATIVE_TIMEDLOCK macro)
+  - Conditionally emulation for "timed join"
+    (see EMULATED_THREADS_USE_NATIVE_TRYJOIN macro)
 */
-struct impl_thrd_param {
-  thrd_start_t func;
-  void *arg;
+#ifndef EMULATED_THREADS_USE_NATIVE_TRYJOIN
+# define EMULATED_THREADS_JOIN_EVENT_BUCKETS 64
+
+struct impl_thrd_event {
+  struct impl_thrd_event *next;
+  pthread_t thr;
+  pthread_cond_t cond;
+  int done;
+  int detached;
 };
 
-static void *
-impl_thrd_routine(void *p) {
-  struct impl_thrd_param pack = *((struct impl_thrd_param *)p);
-  free(p);
-  return (void*)(intptr_t)pack.func(pack.arg);
+static pthread_mutex_t impl_thrd_event_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct impl_thrd_event *impl_thrd_event_tbl[EMULATED_THREADS_JOIN_EVENT_BUCKETS];
+
+static struct impl_thrd_event **
+impl_thrd_event_slot(pthread_t thr) {
+  uintptr_t key = 0;
+  memcpy(&key, &thr, sizeof(thr) < sizeof(key) ? sizeof(thr) : sizeof(key));
+  key ^= key >> 12;
+  return &impl_thrd_event_tbl[key % EMULATED_THREADS_JOIN_EVENT_BUCKETS];
+}
+
+// requires impl_thrd_event_mtx
+static struct impl_thrd_event *
+impl_thrd_event_find(pthread_t thr) {
+  struct impl_thrd_event *ev = *impl_thrd_event_slot(thr);
+  while (ev && !pthread_equal(ev->thr, thr))
+    ev = ev->next;
+  return ev;
 }
 
+// requires impl_thrd_event_mtx
+static void
+impl_thrd_event_free(struct impl_thrd_event *ev) {
+  struct impl_thrd_event **link = impl_thrd_event_slot(ev->thr);
+  while (*link != ev)
+    link = &(*link)->next;
+  *link = ev->next;
+  pthread_cond_destroy(&ev->cond);
+  free(ev);
+}
+
+// cleanup handler of every emulated thread, also run by thrd_exit()
+static void
+impl_thrd_event_signal(void *p) {
+  struct impl_thrd_event *ev = (struct impl_thrd_event *)p;
+  pthread_mutex_lock(&impl_thrd_event_mtx);
+  if (ev->detached) {
+    impl_thrd_event_free(ev);
+  } else {
+    ev->done = 1;
+    pthread_cond_broadcast(&ev->cond);
+  }
+  pthread_mutex_unlock(&impl_thrd_event_mtx);
+}
+
+static void
+impl_thrd_event_release(pthread_t thr, int detach) {
+  struct impl_thrd_event *ev;
+  pthread_mutex_lock(&impl_thrd_event_mtx);
+  ev = impl_thrd_event_find(thr);
+  if (ev) {
+    if (!detach || ev->done)
+      impl_thrd_event_free(ev);
+    else
+      ev->detached = 1;
+  }
+  pthread_mutex_unlock(&impl_thrd_event_mtx);
+}
+#endif
+
+static int impl_thrd_create(thrd_t *, const thrd_attr_t *, thrd_start_t, void *);  // forward decl.
+static void impl_thrd_stack_release(pthread_t);  // forward decl.
+static int impl_thrd_stack_detach(pthread_t);  // forward decl.
+
 
 /*--------------- 7.25.2 Initialization functions ---------------*/
 // 7.25.2.1
@@ -206,17 +329,7 @@ mtx_unlock(mtx_t *mtx) {
 // 7.25.5.1
 int
 thrd_create(thrd_t *thr, thrd_start_t func, void *arg) {
-  struct impl_thrd_param *pack;
-  assert(thr != NULL);
-  pack = (struct impl_thrd_param *)malloc(sizeof(struct impl_thrd_param));
-  if (!pack) return thrd_nomem;
-  pack->func = func;
-  pack->arg = arg;
-  if (pthread_create(thr, NULL, impl_thrd_routine, pack) != 0) {
-    free(pack);
-    return thrd_error;
-  }
-  return thrd_success;
+  return impl_thrd_create(thr, NULL, func, arg);
 }
 
 // 7.25.5.2
@@ -228,7 +341,13 @@ thrd_current(void) {
 // 7.25.5.3
 int
 thrd_detach(thrd_t thr) {
-  return (pthread_detach(thr) == 0) ? thrd_success : thrd_error;
+  // a thread on a pooled stack stays joinable, for the reaper to join
+  if (!impl_thrd_stack_detach(thr) && pthread_detach(thr) != 0)
+    return thrd_error;
+#ifndef EMULATED_THREADS_USE_NATIVE_TRYJOIN
+  impl_thrd_event_release(thr, 1);
+#endif
+  return thrd_success;
 }
 
 // 7.25.5.4
@@ -249,6 +368,10 @@ thrd_join(thrd_t thr, int *res) {
   void *code;
   if (pthread_join(thr, &code) != 0)
     return thrd_error;
+#ifndef EMULATED_THREADS_USE_NATIVE_TRYJOIN
+  impl_thrd_event_release(thr, 0);
+#endif
+  impl_thrd_stack_release(thr);
   if (res)
     *res = (int)(intptr_t)code;
   return thrd_success;
@@ -293,3 +416,1428 @@ int
 tss_set(tss_t key, void *val) {
   return (pthread_setspecific(key, val) == 0) ? thrd_success : thrd_error;
 }
+
+#endif /* !HAVE_THRD_CREATE */
+
+
+/*---------------------- Per-thread state -----------------------*/
+/*
+ * Library state of a thread, reachable both from the thread itself (TLS)
+ * and from its thrd_t (hashed buckets). thrd_create_ex() and the emulated
+ * thrd_create() set it up before they return, so a permit can be handed
+ * to the new thread right away; any other thread registers on first use.
+ * A record is only linked while its thread lives and is unlinked by a TSS
+ * destructor when the thread exits.
+ *
+ * Lookups by thrd_t take no lock: they pin the record through `users`
+ * and check it is still live, and an exiting thread waits for the pins
+ * to drain. Records are never handed back to malloc, only recycled, so
+ * a lookup racing with an exit never touches freed memory.
+ *
+ * Registering also hands out the thread's dense index: the lowest numbers
+ * released by exited threads are reused before the range grows.
+ */
+#define IMPL_PARK_EMPTY    0u
+#define IMPL_PARK_NOTIFIED 1u
+#define IMPL_PARK_PARKED   UINT32_MAX  /* EMPTY - 1 */
+
+#define IMPL_STATE_NEW  0u  /* not linked yet */
+#define IMPL_STATE_LIVE 1u  /* linked, its thread runs */
+#define IMPL_STATE_DEAD 2u  /* unlinked, its thread exited */
+
+struct impl_thrd_state {
+  struct impl_thrd_state *next;
+  struct impl_thrd_state *free_next;
+  uintptr_t key;  /* hash of thr, checked before pinning */
+  pthread_t thr;
+  uint32_t state; /* IMPL_STATE_* */
+  uint32_t users; /* pins, plus one held by the creator until linked */
+  int index;
+#if defined(__linux__)
+  pid_t tid;      /* 0 until the thread runs */
+#endif
+  uint32_t park;
+  int wait_policy;     /* thrd_wait_*, of the thread itself */
+  long wait_spin_nsec;
+#ifndef EMULATED_THREADS_USE_FUTEX
+  pthread_mutex_t park_mtx;
+  pthread_cond_t park_cnd;
+#endif
+};
+
+static struct impl_thrd_bucket {
+  pthread_mutex_t mtx;
+  struct impl_thrd_state *head;
+} impl_thrd_state_tbl[EMULATED_THREADS_STATE_BUCKETS];
+
+static pthread_once_t impl_thrd_state_once = PTHREAD_ONCE_INIT;
+static pthread_key_t impl_thrd_state_key;
+static _Thread_local struct impl_thrd_state *impl_thrd_self;
+
+static pthread_mutex_t impl_thrd_state_free_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct impl_thrd_state *impl_thrd_state_free;
+
+static pthread_mutex_t impl_thrd_index_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int *impl_thrd_index_free;   /* released indices, lowest on top */
+static int impl_thrd_index_nfree;
+static int impl_thrd_index_cap;
+static int32_t impl_thrd_index_next; /* high-water mark */
+
+/* index + 1, so that zero means "not registered" */
+#if defined(__GNUC__)
+static _Thread_local int impl_thrd_index_tls __attribute__((tls_model("initial-exec")));
+#else
+static _Thread_local int impl_thrd_index_tls;
+#endif
+
+static int
+impl_thrd_index_acquire(void) {
+  int index;
+  pthread_mutex_lock(&impl_thrd_index_mtx);
+  if (impl_thrd_index_nfree > 0) {
+    index = impl_thrd_index_free[--impl_thrd_index_nfree];
+  } else {
+    // size the free stack for every index handed out, so release never fails
+    if (impl_thrd_index_next == impl_thrd_index_cap) {
+      int cap = impl_thrd_index_cap ? impl_thrd_index_cap * 2 : 64;
+      int *tbl = (int *)realloc(impl_thrd_index_free, (size_t)cap * sizeof(int));
+      if (!tbl) {
+        pthread_mutex_unlock(&impl_thrd_index_mtx);
+        return -1;
+      }
+      impl_thrd_index_free = tbl;
+      impl_thrd_index_cap = cap;
+    }
+    index = impl_thrd_index_next;
+    evo_atomic_store_i32(&impl_thrd_index_next, index + 1, EVO_ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&impl_thrd_index_mtx);
+  return index;
+}
+
+static void
+impl_thrd_index_release(int index) {
+  int i;
+  pthread_mutex_lock(&impl_thrd_index_mtx);
+  // keep the stack sorted descending so the lowest index is reused first
+  for (i = impl_thrd_index_nfree; i > 0 && impl_thrd_index_free[i - 1] < index; i--)
+    impl_thrd_index_free[i] = impl_thrd_index_free[i - 1];
+  impl_thrd_index_free[i] = index;
+  impl_thrd_index_nfree++;
+  pthread_mutex_unlock(&impl_thrd_index_mtx);
+}
+
+static uintptr_t
+impl_thrd_hash(pthread_t thr) {
+  uintptr_t key = 0;
+  memcpy(&key, &thr, sizeof(thr) < sizeof(key) ? sizeof(thr) : sizeof(key));
+  return key ^ (key >> 12);
+}
+
+static struct impl_thrd_bucket *
+impl_thrd_state_bucket(pthread_t thr) {
+  return &impl_thrd_state_tbl[impl_thrd_hash(thr) % EMULATED_THREADS_STATE_BUCKETS];
+}
+
+static void
+impl_thrd_state_recycle(struct impl_thrd_state *st) {
+  pthread_mutex_lock(&impl_thrd_state_free_mtx);
+  st->free_next = impl_thrd_state_free;
+  impl_thrd_state_free = st;
+  pthread_mutex_unlock(&impl_thrd_state_free_mtx);
+}
+
+/* A fresh record with an index, pinned once on behalf of its creator */
+static struct impl_thrd_state *
+impl_thrd_state_alloc(void) {
+  struct impl_thrd_state *st;
+  pthread_mutex_lock(&impl_thrd_state_free_mtx);
+  st = impl_thrd_state_free;
+  if (st)
+    impl_thrd_state_free = st->free_next;
+  pthread_mutex_unlock(&impl_thrd_state_free_mtx);
+  if (!st) {
+    st = (struct impl_thrd_state *)calloc(1, sizeof(struct impl_thrd_state));
+    if (!st)
+      return NULL;
+#ifndef EMULATED_THREADS_USE_FUTEX
+    pthread_mutex_init(&st->park_mtx, NULL);
+    pthread_cond_init(&st->park_cnd, NULL);
+#endif
+  }
+  st->index = impl_thrd_index_acquire();
+  if (st->index < 0) {
+    impl_thrd_state_recycle(st);
+    return NULL;
+  }
+#if defined(__linux__)
+  st->tid = 0;
+#endif
+  st->park = IMPL_PARK_EMPTY;
+  st->wait_policy = thrd_wait_block;
+  st->wait_spin_nsec = 0;
+  evo_atomic_store_u32(&st->state, IMPL_STATE_NEW, EVO_ATOMIC_RELAXED);
+  // a stale lookup may hold a transient pin, so add rather than store
+  evo_atomic_fetch_add_u32(&st->users, 1, EVO_ATOMIC_RELAXED);
+  return st;
+}
+
+/* Makes `st` reachable from `thr` unless its thread already exited */
+static void
+impl_thrd_state_link(struct impl_thrd_state *st, pthread_t thr) {
+  struct impl_thrd_bucket *b = impl_thrd_state_bucket(thr);
+  pthread_mutex_lock(&b->mtx);
+  if (st->state == IMPL_STATE_NEW) {
+    st->thr = thr;
+    evo_atomic_store_uptr(&st->key, impl_thrd_hash(thr), EVO_ATOMIC_RELAXED);
+    evo_atomic_store_ptr((void **)&st->next, b->head, EVO_ATOMIC_RELAXED);
+    evo_atomic_store_u32(&st->state, IMPL_STATE_LIVE, EVO_ATOMIC_SEQ_CST);
+    evo_atomic_store_ptr((void **)&b->head, st, EVO_ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&b->mtx);
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+}
+
+/* Creation failed: the thread never ran */
+static void
+impl_thrd_state_discard(struct impl_thrd_state *st) {
+  impl_thrd_index_release(st->index);
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELAXED);
+  impl_thrd_state_recycle(st);
+}
+
+// TSS destructor of the exiting thread
+static void
+impl_thrd_state_release(void *p) {
+  struct impl_thrd_state *st = (struct impl_thrd_state *)p;
+  struct impl_thrd_bucket *b = impl_thrd_state_bucket(pthread_self());
+  struct impl_thrd_state **link;
+  pthread_mutex_lock(&b->mtx);
+  if (st->state == IMPL_STATE_LIVE) {
+    for (link = &b->head; *link != st; link = &(*link)->next)
+      ;
+    evo_atomic_store_ptr((void **)link, st->next, EVO_ATOMIC_RELEASE);
+  }
+  evo_atomic_store_u32(&st->state, IMPL_STATE_DEAD, EVO_ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&b->mtx);
+  impl_thrd_index_release(st->index);
+  impl_thrd_self = NULL;
+  impl_thrd_index_tls = 0;
+  // wait out thrd_unpark() calls still on the record, and a creator
+  // that has not linked it yet
+  while (evo_atomic_load_u32(&st->users, EVO_ATOMIC_SEQ_CST) != 0)
+    sched_yield();
+  impl_thrd_state_recycle(st);
+}
+
+static void
+impl_thrd_state_init(void) {
+  int i;
+  for (i = 0; i < EMULATED_THREADS_STATE_BUCKETS; i++)
+    pthread_mutex_init(&impl_thrd_state_tbl[i].mtx, NULL);
+  pthread_key_create(&impl_thrd_state_key, impl_thrd_state_release);
+}
+
+/* Binds `st` to the calling thread */
+static void
+impl_thrd_state_adopt(struct impl_thrd_state *st) {
+#if defined(__linux__)
+  struct impl_thrd_bucket *b = impl_thrd_state_bucket(pthread_self());
+  pthread_mutex_lock(&b->mtx);
+  st->tid = (pid_t)syscall(SYS_gettid);
+  pthread_mutex_unlock(&b->mtx);
+#endif
+  pthread_setspecific(impl_thrd_state_key, st);
+  impl_thrd_self = st;
+  impl_thrd_index_tls = st->index + 1;
+}
+
+// requires the bucket lock
+static struct impl_thrd_state *
+impl_thrd_state_find(struct impl_thrd_bucket *b, pthread_t thr) {
+  struct impl_thrd_state *st;
+  for (st = b->head; st; st = st->next) {
+    if (pthread_equal(st->thr, thr))
+      return st;
+  }
+  return NULL;
+}
+
+/* Live record of `thr`, pinned against its release; NULL if none */
+static struct impl_thrd_state *
+impl_thrd_state_pin(pthread_t thr) {
+  uintptr_t key = impl_thrd_hash(thr);
+  struct impl_thrd_bucket *b = &impl_thrd_state_tbl[key % EMULATED_THREADS_STATE_BUCKETS];
+  struct impl_thrd_state *st;
+  st = (struct impl_thrd_state *)evo_atomic_load_ptr((void **)&b->head, EVO_ATOMIC_ACQUIRE);
+  for (; st; st = (struct impl_thrd_state *)evo_atomic_load_ptr((void **)&st->next, EVO_ATOMIC_ACQUIRE)) {
+    if (evo_atomic_load_uptr(&st->key, EVO_ATOMIC_RELAXED) != key)
+      continue;
+    // pairs with the DEAD store and `users` load of the release
+    evo_atomic_fetch_add_u32(&st->users, 1, EVO_ATOMIC_SEQ_CST);
+    if (evo_atomic_load_u32(&st->state, EVO_ATOMIC_SEQ_CST) == IMPL_STATE_LIVE
+        && pthread_equal(st->thr, thr))
+      return st;
+    evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void
+impl_thrd_state_unpin(struct impl_thrd_state *st) {
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+}
+
+static struct impl_thrd_state *
+impl_thrd_state_register(void) {
+  struct impl_thrd_state *st = impl_thrd_self;
+  if (st)
+    return st;
+  pthread_once(&impl_thrd_state_once, impl_thrd_state_init);
+  st = impl_thrd_state_alloc();
+  if (!st)
+    return NULL;
+  impl_thrd_state_link(st, pthread_self());
+  impl_thrd_state_adopt(st);
+  return st;
+}
+
+static struct impl_thrd_state *
+impl_thrd_state_self(void) {
+  struct impl_thrd_state *st = impl_thrd_state_register();
+  if (!st)
+    abort(); /* out of memory before the thread could ever block */
+  return st;
+}
+#ifdef EMULATED_THREADS_USE_FUTEX
+static int
+impl_futex_wait(uint32_t *word, uint32_t val, const struct timespec *abs_time) {
+  if (!abs_time)
+    return (int)syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+  return (int)syscall(SYS_futex, word,
+                      FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+                      val, abs_time, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static void
+impl_futex_wake(uint32_t *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+static int
+impl_timespec_before(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Spinning part of the poll and hybrid wait policies: thrd_success once
+ * a permit is consumed, thrd_timedout at `abs_time`, thrd_busy when the
+ * hybrid budget is spent. The state stays EMPTY meanwhile, so unpark
+ * never has to wake the spinner.
+ */
+static int
+impl_thrd_park_spin(struct impl_thrd_state *st, const struct timespec *abs_time) {
+  int poll = st->wait_policy == thrd_wait_poll;
+  struct timespec now, until;
+  unsigned n;
+  if (!poll) {
+    timespec_get(&until, TIME_UTC);
+    until.tv_sec += st->wait_spin_nsec / 1000000000L;
+    until.tv_nsec += st->wait_spin_nsec % 1000000000L;
+    if (until.tv_nsec >= 1000000000L) {
+      until.tv_sec += 1;
+      until.tv_nsec -= 1000000000L;
+    }
+  }
+  for (n = 1;; n++) {
+    uint32_t expected = IMPL_PARK_NOTIFIED;
+    if (evo_atomic_load_u32(&st->park, EVO_ATOMIC_RELAXED) == IMPL_PARK_NOTIFIED
+        && evo_atomic_cas_u32(&st->park, &expected, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE))
+      return thrd_success;
+    evo_cpu_relax();
+    // the clock is read every so often only, a call costs a few spins
+    if ((n & 63) == 0 && (abs_time || !poll)) {
+      timespec_get(&now, TIME_UTC);
+      if (abs_time && !impl_timespec_before(&now, abs_time))
+        return thrd_timedout;
+      if (!poll && !impl_timespec_before(&now, &until))
+        return thrd_busy;
+    }
+  }
+}
+
+static int
+impl_thrd_park(const struct timespec *abs_time) {
+  struct impl_thrd_state *st = impl_thrd_state_self();
+
+  if (st->wait_policy != thrd_wait_block) {
+    int rt = impl_thrd_park_spin(st, abs_time);
+    if (rt != thrd_busy)
+      return rt;
+  }
+
+  // NOTIFIED -> EMPTY consumes the permit, EMPTY -> PARKED announces a sleeper
+  if (evo_atomic_fetch_sub_u32(&st->park, 1, EVO_ATOMIC_ACQUIRE) == IMPL_PARK_NOTIFIED)
+    return thrd_success;
+
+  for (;;) {
+    uint32_t expected = IMPL_PARK_NOTIFIED;
+#ifdef EMULATED_THREADS_USE_FUTEX
+    // EAGAIN: no longer PARKED, EINTR: a signal; anything else ends the wait
+    if (impl_futex_wait(&st->park, IMPL_PARK_PARKED, abs_time) != 0
+        && errno != EAGAIN && errno != EINTR) {
+      int timedout = errno == ETIMEDOUT;
+      if (evo_atomic_exchange_u32(&st->park, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE)
+          == IMPL_PARK_NOTIFIED)
+        return thrd_success;
+      return timedout ? thrd_timedout : thrd_error;
+    }
+#else
+    int rt = 0;
+    pthread_mutex_lock(&st->park_mtx);
+    while (rt == 0 && evo_atomic_load_u32(&st->park, EVO_ATOMIC_RELAXED) == IMPL_PARK_PARKED) {
+      rt = abs_time
+        ? pthread_cond_timedwait(&st->park_cnd, &st->park_mtx, abs_time)
+        : pthread_cond_wait(&st->park_cnd, &st->park_mtx);
+    }
+    pthread_mutex_unlock(&st->park_mtx);
+    if (rt != 0) {
+      if (evo_atomic_exchange_u32(&st->park, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE)
+          == IMPL_PARK_NOTIFIED)
+        return thrd_success;
+      return (rt == ETIMEDOUT) ? thrd_timedout : thrd_error;
+    }
+#endif
+    if (evo_atomic_cas_u32(&st->park, &expected, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE))
+      return thrd_success;
+    // spurious wakeup, still PARKED
+  }
+}
+
+
+/*-------------------------- Scheduling -------------------------*/
+static const int impl_sched_policy_tbl[] = {
+  SCHED_OTHER,
+  SCHED_FIFO,
+  SCHED_RR,
+#ifdef SCHED_BATCH
+  SCHED_BATCH,
+#else
+  -1,
+#endif
+#ifdef SCHED_IDLE
+  SCHED_IDLE,
+#else
+  -1,
+#endif
+};
+
+static int
+impl_sched_error(int err) {
+  return (err == EPERM || err == EACCES) ? thrd_noperm : thrd_error;
+}
+
+#if defined(__linux__)
+/* Kernel thread id of `thr`, 0 when unknown */
+static pid_t
+impl_thrd_tid(thrd_t thr) {
+#if defined(HAVE_PTHREAD_GETTID_NP)
+  return pthread_gettid_np(thr);
+#else
+  struct impl_thrd_bucket *b;
+  struct impl_thrd_state *st;
+  pid_t tid;
+  if (pthread_equal(thr, pthread_self()))
+    return (pid_t)syscall(SYS_gettid);
+  pthread_once(&impl_thrd_state_once, impl_thrd_state_init);
+  b = impl_thrd_state_bucket(thr);
+  pthread_mutex_lock(&b->mtx);
+  st = impl_thrd_state_find(b, thr);
+  tid = st ? st->tid : 0;
+  pthread_mutex_unlock(&b->mtx);
+  return tid;
+#endif
+}
+
+/* struct sched_attr of sched_setattr(2), SCHED_ATTR_SIZE_VER1 */
+struct impl_sched_attr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+  uint32_t sched_util_min;
+  uint32_t sched_util_max;
+};
+#endif
+
+
+/*------------------------ CPU placement ------------------------*/
+#if defined(__linux__)
+static void
+impl_cpuset_to_native(const thrd_cpuset_t *set, cpu_set_t *cs) {
+  int cpu;
+  CPU_ZERO(cs);
+  for (cpu = 0; cpu < THRD_CPUSET_SIZE && cpu < CPU_SETSIZE; cpu++) {
+    if (THRD_CPU_ISSET(cpu, set))
+      CPU_SET(cpu, cs);
+  }
+}
+
+static void
+impl_cpuset_from_native(const cpu_set_t *cs, thrd_cpuset_t *set) {
+  int cpu;
+  memset(set, 0, sizeof(*set));
+  for (cpu = 0; cpu < THRD_CPUSET_SIZE && cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, cs))
+      THRD_CPU_SET(cpu, set);
+  }
+}
+
+/* Reads a sysfs CPU list such as "0-3,8-11" */
+static int
+impl_cpuset_read(const char *path, thrd_cpuset_t *set) {
+  FILE *f = fopen(path, "r");
+  long lo, hi;
+  int c;
+  if (!f)
+    return thrd_error;
+  memset(set, 0, sizeof(*set));
+  while (fscanf(f, "%ld", &lo) == 1 && lo >= 0) {
+    hi = lo;
+    c = fgetc(f);
+    if (c == '-') {
+      if (fscanf(f, "%ld", &hi) != 1)
+        break;
+      c = fgetc(f);
+    }
+    for (; lo <= hi && lo < THRD_CPUSET_SIZE; lo++)
+      THRD_CPU_SET(lo, set);
+    if (c != ',')
+      break;
+  }
+  fclose(f);
+  return thrd_success;
+}
+
+/* Last-level cache: the cache index of `cpu` with the highest level */
+static int
+impl_cpuset_read_llc(int cpu, thrd_cpuset_t *set) {
+  char path[96];
+  int index, best = -1, best_level = 0;
+  for (index = 0; index < 16; index++) {
+    FILE *f;
+    int level;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+    if (!(f = fopen(path, "r")))
+      break;
+    if (fscanf(f, "%d", &level) == 1 && level > best_level) {
+      best_level = level;
+      best = index;
+    }
+    fclose(f);
+  }
+  if (best < 0)
+    return thrd_error;
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, best);
+  return impl_cpuset_read(path, set);
+}
+
+static int
+impl_cpuset_read_node(int cpu, thrd_cpuset_t *set) {
+  char path[96];
+  struct dirent *ent;
+  DIR *dir;
+  int node = -1;
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  if (!(dir = opendir(path)))
+    return thrd_error;
+  while (node < 0 && (ent = readdir(dir)) != NULL) {
+    if (sscanf(ent->d_name, "node%d", &node) != 1)
+      node = -1;
+  }
+  closedir(dir);
+  // a kernel without NUMA support has every CPU on one node
+  if (node < 0)
+    return impl_cpuset_read("/sys/devices/system/cpu/online", set);
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  return impl_cpuset_read(path, set);
+}
+#endif
+
+static int
+impl_thrd_attr_affinity(pthread_attr_t *pattr, const thrd_cpuset_t *set) {
+#if defined(__linux__) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+  cpu_set_t cs;
+  impl_cpuset_to_native(set, &cs);
+  return (pthread_attr_setaffinity_np(pattr, sizeof(cs), &cs) == 0) ? thrd_success : thrd_error;
+#else
+  (void)pattr;
+  (void)set;
+  return thrd_error;
+#endif
+}
+
+
+/*------------------------- Stack pools -------------------------*/
+#if !defined(HAVE_THRD_CREATE)
+#define EMULATED_THREADS_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/*
+ * Pooled stack lent to a thread. The thread descriptor lives on the
+ * stack too, so it is only free once the thread has been joined: by the
+ * owner of a joinable thread, or, for a detached one, by the reaper.
+ * thrd_detach() leaves a pooled thread joinable and moves its record to
+ * the reap list; the next thread created from the same pool, or the
+ * destruction of the pool, joins those that have exited.
+ */
+struct impl_thrd_stack {
+  struct impl_thrd_stack *next;
+  pthread_t thr;
+  thrd_stack_pool_t *pool;  /* NULL once the pool is destroyed */
+  void *stack;
+  size_t stack_size;
+  size_t guard_size;
+  uint32_t exited;
+};
+
+static pthread_mutex_t impl_thrd_stack_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct impl_thrd_stack *impl_thrd_stack_tbl[EMULATED_THREADS_STATE_BUCKETS];
+static struct impl_thrd_stack *impl_thrd_stack_reap_list;
+static int32_t impl_thrd_stack_busy;
+
+static void *
+impl_thrd_stack_map(const thrd_stack_pool_t *pool) {
+  size_t align = (pool->flags & thrd_stack_hugepages) ? EMULATED_THREADS_HUGE_PAGE_SIZE : 0;
+  size_t len = pool->guard_size + pool->stack_size + align;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  char *base, *stack;
+#ifdef MAP_STACK
+  flags |= MAP_STACK;
+#endif
+  base = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (base == (char *)MAP_FAILED)
+    return NULL;
+  stack = base + pool->guard_size;
+  if (align) {
+    // huge pages only back whole aligned extents: trim the slack so that
+    // the stack itself starts on a huge page boundary
+    char *aligned = (char *)(((uintptr_t)stack + align - 1) & ~(uintptr_t)(align - 1));
+    size_t head = (size_t)(aligned - stack);
+    if (head)
+      munmap(base, head);
+    if (head != align)
+      munmap(aligned + pool->stack_size, align - head);
+    stack = aligned;
+    base = stack - pool->guard_size;
+#ifdef MADV_HUGEPAGE
+    madvise(stack, pool->stack_size, MADV_HUGEPAGE);
+#endif
+  }
+  mprotect(base, pool->guard_size, PROT_NONE);
+  if (pool->flags & thrd_stack_prefault) {
+    size_t off;
+    for (off = 0; off < pool->stack_size; off += pool->guard_size)
+      ((volatile char *)stack)[off] = 0;
+  }
+  return stack;
+}
+
+static void
+impl_thrd_stack_unmap(void *stack, size_t stack_size, size_t guard_size) {
+  munmap((char *)stack - guard_size, guard_size + stack_size);
+}
+
+static void
+impl_thrd_stack_put(thrd_stack_pool_t *pool, void *stack) {
+  mtx_lock(&pool->mtx);
+  *(void **)stack = pool->free;
+  pool->free = stack;
+  mtx_unlock(&pool->mtx);
+}
+
+static struct impl_thrd_stack **
+impl_thrd_stack_slot(pthread_t thr) {
+  uintptr_t key = 0;
+  memcpy(&key, &thr, sizeof(thr) < sizeof(key) ? sizeof(thr) : sizeof(key));
+  key ^= key >> 12;
+  return &impl_thrd_stack_tbl[key % EMULATED_THREADS_STATE_BUCKETS];
+}
+
+// the joined thread of `rec` is gone: its stack goes back or away
+static void
+impl_thrd_stack_recycle(struct impl_thrd_stack *rec) {
+  if (rec->pool)
+    impl_thrd_stack_put(rec->pool, rec->stack);
+  else
+    impl_thrd_stack_unmap(rec->stack, rec->stack_size, rec->guard_size);
+  free(rec);
+}
+
+/*
+ * Joins the detached threads of `pool` (and of destroyed pools) that
+ * have exited, or with `wait` all of those of `pool`, and recycles their
+ * stacks.
+ */
+static void
+impl_thrd_stack_reap(thrd_stack_pool_t *pool, int wait) {
+  struct impl_thrd_stack **link, *rec, *done = NULL;
+  if (!evo_atomic_load_ptr((void **)&impl_thrd_stack_reap_list, EVO_ATOMIC_RELAXED))
+    return;
+  pthread_mutex_lock(&impl_thrd_stack_mtx);
+  for (link = &impl_thrd_stack_reap_list; (rec = *link) != NULL;) {
+    int exited = evo_atomic_load_u32(&rec->exited, EVO_ATOMIC_ACQUIRE);
+    if ((rec->pool == pool && (exited || wait)) || (!rec->pool && exited)) {
+      evo_atomic_store_ptr((void **)link, rec->next, EVO_ATOMIC_RELAXED);
+      rec->next = done;
+      done = rec;
+    } else {
+      link = &rec->next;
+    }
+  }
+  pthread_mutex_unlock(&impl_thrd_stack_mtx);
+  while ((rec = done) != NULL) {
+    done = rec->next;
+    pthread_join(rec->thr, NULL);
+    impl_thrd_stack_recycle(rec);
+  }
+}
+
+static struct impl_thrd_stack *
+impl_thrd_stack_acquire(thrd_stack_pool_t *pool) {
+  struct impl_thrd_stack *rec;
+  rec = (struct impl_thrd_stack *)calloc(1, sizeof(struct impl_thrd_stack));
+  if (!rec)
+    return NULL;
+  impl_thrd_stack_reap(pool, 0);
+  mtx_lock(&pool->mtx);
+  rec->stack = pool->free;
+  if (rec->stack)
+    pool->free = *(void **)rec->stack;
+  mtx_unlock(&pool->mtx);
+  if (!rec->stack)
+    rec->stack = impl_thrd_stack_map(pool);
+  if (!rec->stack) {
+    free(rec);
+    return NULL;
+  }
+  rec->pool = pool;
+  rec->stack_size = pool->stack_size;
+  rec->guard_size = pool->guard_size;
+  return rec;
+}
+
+static void
+impl_thrd_stack_track(struct impl_thrd_stack *rec, pthread_t thr) {
+  struct impl_thrd_stack **slot;
+  pthread_mutex_lock(&impl_thrd_stack_mtx);
+  rec->thr = thr;
+  slot = impl_thrd_stack_slot(thr);
+  rec->next = *slot;
+  *slot = rec;
+  evo_atomic_fetch_add_i32(&impl_thrd_stack_busy, 1, EVO_ATOMIC_RELAXED);
+  pthread_mutex_unlock(&impl_thrd_stack_mtx);
+}
+
+// cleanup handler of a thread on a pooled stack, also run by thrd_exit()
+static void
+impl_thrd_stack_exit(void *p) {
+  if (p)
+    evo_atomic_store_u32(&((struct impl_thrd_stack *)p)->exited, 1, EVO_ATOMIC_RELEASE);
+}
+
+static struct impl_thrd_stack *
+impl_thrd_stack_untrack(pthread_t thr) {
+  struct impl_thrd_stack **link, *rec;
+  if (evo_atomic_load_i32(&impl_thrd_stack_busy, EVO_ATOMIC_RELAXED) == 0)
+    return NULL;
+  pthread_mutex_lock(&impl_thrd_stack_mtx);
+  link = impl_thrd_stack_slot(thr);
+  while (*link && !pthread_equal((*link)->thr, thr))
+    link = &(*link)->next;
+  rec = *link;
+  if (rec) {
+    *link = rec->next;
+    evo_atomic_fetch_sub_i32(&impl_thrd_stack_busy, 1, EVO_ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&impl_thrd_stack_mtx);
+  return rec;
+}
+
+// `thr` was joined: its stack, if pooled, is done with
+static void
+impl_thrd_stack_release(pthread_t thr) {
+  struct impl_thrd_stack *rec = impl_thrd_stack_untrack(thr);
+  if (rec)
+    impl_thrd_stack_recycle(rec);
+}
+
+// `thr` is being detached: non-zero if the reaper is to join it instead
+static int
+impl_thrd_stack_detach(pthread_t thr) {
+  struct impl_thrd_stack *rec = impl_thrd_stack_untrack(thr);
+  if (!rec)
+    return 0;
+  pthread_mutex_lock(&impl_thrd_stack_mtx);
+  rec->next = impl_thrd_stack_reap_list;
+  evo_atomic_store_ptr((void **)&impl_thrd_stack_reap_list, rec, EVO_ATOMIC_RELAXED);
+  pthread_mutex_unlock(&impl_thrd_stack_mtx);
+  return 1;
+}
+
+// stacks still lent out by `pool` are unmapped when their thread is joined
+static void
+impl_thrd_stack_orphan(thrd_stack_pool_t *pool) {
+  struct impl_thrd_stack *rec;
+  int i;
+  pthread_mutex_lock(&impl_thrd_stack_mtx);
+  for (i = 0; i < EMULATED_THREADS_STATE_BUCKETS; i++) {
+    for (rec = impl_thrd_stack_tbl[i]; rec; rec = rec->next) {
+      if (rec->pool == pool)
+        rec->pool = NULL;
+    }
+  }
+  pthread_mutex_unlock(&impl_thrd_stack_mtx);
+}
+#endif
+
+
+/*------------------------ Thread creation ----------------------*/
+#if defined(__linux__) && defined(SYS_set_mempolicy) && defined(SYS_get_mempolicy)
+# define EMULATED_THREADS_MEMPOLICY_MAXNODE 1024
+
+/* MPOL_* of <numaif.h>, by thrd_mempolicy_* */
+static const int impl_mempolicy_tbl[] = {
+  0, /* MPOL_DEFAULT */
+  2, /* MPOL_BIND */
+  1, /* MPOL_PREFERRED */
+  3, /* MPOL_INTERLEAVE */
+};
+
+struct impl_mempolicy {
+  int mode;
+  unsigned long nodes[EMULATED_THREADS_MEMPOLICY_MAXNODE / (CHAR_BIT * sizeof(unsigned long))];
+};
+
+static int
+impl_mempolicy_get(struct impl_mempolicy *mp) {
+  return (int)syscall(SYS_get_mempolicy, &mp->mode, mp->nodes,
+                      (unsigned long)EMULATED_THREADS_MEMPOLICY_MAXNODE, NULL, 0UL);
+}
+
+static int
+impl_mempolicy_set(const struct impl_mempolicy *mp) {
+  // the kernel takes one more than the number of mask bits
+  return (int)syscall(SYS_set_mempolicy, mp->mode, mp->nodes,
+                      (unsigned long)EMULATED_THREADS_MEMPOLICY_MAXNODE + 1);
+}
+#endif
+
+struct impl_thrd_param {
+  thrd_start_t func;
+  void *arg;
+  struct impl_thrd_state *state;
+#if !defined(HAVE_THRD_CREATE)
+  struct impl_thrd_stack *stack;
+#endif
+#if !defined(HAVE_THRD_CREATE) && !defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  struct impl_thrd_event *event;
+#endif
+};
+
+static void *
+impl_thrd_routine(void *p) {
+  struct impl_thrd_param pack = *((struct impl_thrd_param *)p);
+  void *code;
+  free(p);
+  impl_thrd_state_adopt(pack.state);
+#if !defined(HAVE_THRD_CREATE)
+  pthread_cleanup_push(impl_thrd_stack_exit, pack.stack);
+#endif
+#if !defined(HAVE_THRD_CREATE) && !defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  pthread_cleanup_push(impl_thrd_event_signal, pack.event);
+#endif
+  code = (void*)(intptr_t)pack.func(pack.arg);
+#if !defined(HAVE_THRD_CREATE) && !defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  pthread_cleanup_pop(1);
+#endif
+#if !defined(HAVE_THRD_CREATE)
+  pthread_cleanup_pop(1);
+#endif
+  return code;
+}
+
+static int
+impl_thrd_spawn(thrd_t *thr, const pthread_attr_t *pattr, struct impl_thrd_param *pack) {
+#if !defined(HAVE_THRD_CREATE) && !defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  struct impl_thrd_event *ev;
+  ev = (struct impl_thrd_event *)calloc(1, sizeof(struct impl_thrd_event));
+  if (!ev)
+    return thrd_nomem;
+  pthread_cond_init(&ev->cond, NULL);
+  pack->event = ev;
+  // the new thread only touches its event under the lock, so it can't
+  // observe it before it is linked into the table
+  pthread_mutex_lock(&impl_thrd_event_mtx);
+  if (pthread_create(thr, pattr, impl_thrd_routine, pack) != 0) {
+    pthread_mutex_unlock(&impl_thrd_event_mtx);
+    pthread_cond_destroy(&ev->cond);
+    free(ev);
+    return thrd_error;
+  }
+  ev->thr = *thr;
+  ev->next = *impl_thrd_event_slot(*thr);
+  *impl_thrd_event_slot(*thr) = ev;
+  pthread_mutex_unlock(&impl_thrd_event_mtx);
+  return thrd_success;
+#else
+  return (pthread_create(thr, pattr, impl_thrd_routine, pack) == 0) ? thrd_success : thrd_error;
+#endif
+}
+
+static int
+impl_thrd_create(thrd_t *thr, const thrd_attr_t *attr, thrd_start_t func, void *arg) {
+  struct impl_thrd_param *pack;
+  struct impl_thrd_state *state;
+#if !defined(HAVE_THRD_CREATE)
+  struct impl_thrd_stack *rec = NULL;
+#endif
+  pthread_attr_t pattr;
+  int use_pattr = attr && (attr->stack_size != 0 || attr->stack_pool || attr->affinity);
+  int use_policy = attr && attr->mempolicy != thrd_mempolicy_default;
+  int rt = thrd_success;
+#if defined(EMULATED_THREADS_MEMPOLICY_MAXNODE)
+  struct impl_mempolicy saved;
+#endif
+  assert(thr != NULL);
+  // the creator is registered too, so its new thread can unpark it
+  if (!impl_thrd_state_register())
+    return thrd_nomem;
+  pack = (struct impl_thrd_param *)malloc(sizeof(struct impl_thrd_param));
+  if (!pack) return thrd_nomem;
+  pack->func = func;
+  pack->arg = arg;
+  pack->state = state = impl_thrd_state_alloc();
+  if (!state) {
+    free(pack);
+    return thrd_nomem;
+  }
+  if (use_pattr) {
+    pthread_attr_init(&pattr);
+    if (attr->stack_pool) {
+#if !defined(HAVE_THRD_CREATE)
+      rec = impl_thrd_stack_acquire(attr->stack_pool);
+      if (rec)
+        pthread_attr_setstack(&pattr, rec->stack, rec->stack_size);
+      else
+        rt = thrd_nomem;
+#else
+      // the C library's thrd_join() goes unseen, the stack would never return
+      rt = thrd_error;
+#endif
+    } else if (attr->stack_size != 0
+               && pthread_attr_setstacksize(&pattr, attr->stack_size) != 0) {
+      rt = thrd_error;
+    }
+    if (rt == thrd_success && attr->affinity)
+      rt = impl_thrd_attr_affinity(&pattr, attr->affinity);
+  }
+  // a new thread inherits the memory policy of its creator, so the
+  // creator switches to the requested one for the duration of the call
+#if !defined(HAVE_THRD_CREATE)
+  pack->stack = rec;
+#endif
+  if (rt == thrd_success && use_policy) {
+#if defined(EMULATED_THREADS_MEMPOLICY_MAXNODE)
+    if (impl_mempolicy_get(&saved) != 0)
+      rt = thrd_error;
+    else
+      rt = thrd_setmempolicy(attr->mempolicy, attr->mempolicy_nodes);
+#else
+    rt = thrd_error;
+#endif
+  }
+  if (rt == thrd_success) {
+    rt = impl_thrd_spawn(thr, use_pattr ? &pattr : NULL, pack);
+#if defined(EMULATED_THREADS_MEMPOLICY_MAXNODE)
+    if (use_policy)
+      impl_mempolicy_set(&saved);
+#endif
+  }
+  if (use_pattr)
+    pthread_attr_destroy(&pattr);
+#if !defined(HAVE_THRD_CREATE)
+  if (rec && rt == thrd_success)
+    impl_thrd_stack_track(rec, *thr);
+  else if (rec)
+    impl_thrd_stack_recycle(rec);
+#endif
+  // linked before returning, so `*thr` can be unparked right away
+  if (rt == thrd_success) {
+    impl_thrd_state_link(state, *thr);
+  } else {
+    impl_thrd_state_discard(state);
+    free(pack);
+  }
+  return rt;
+}
+
+
+/*------------------------- Extensions --------------------------*/
+int
+thrd_tryjoin(thrd_t thr, int *res) {
+#if defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  void *code;
+  int rt = pthread_tryjoin_np(thr, &code);
+  if (rt == EBUSY)
+    return thrd_busy;
+  if (rt != 0)
+    return thrd_error;
+#if !defined(HAVE_THRD_CREATE)
+  impl_thrd_stack_release(thr);
+#endif
+  if (res)
+    *res = (int)(intptr_t)code;
+  return thrd_success;
+#else
+  struct impl_thrd_event *ev;
+  int done;
+  pthread_mutex_lock(&impl_thrd_event_mtx);
+  ev = impl_thrd_event_find(thr);
+  done = ev ? ev->done : -1;
+  pthread_mutex_unlock(&impl_thrd_event_mtx);
+  if (done < 0)
+    return thrd_error;
+  if (!done)
+    return thrd_busy;
+  return thrd_join(thr, res);
+#endif
+}
+
+int
+thrd_join_until(thrd_t thr, int *res, const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  {
+#if defined(EMULATED_THREADS_USE_NATIVE_TRYJOIN)
+  void *code;
+  int rt = pthread_timedjoin_np(thr, &code, abs_time);
+  if (rt == ETIMEDOUT)
+    return thrd_timedout;
+  if (rt != 0)
+    return thrd_error;
+#if !defined(HAVE_THRD_CREATE)
+  impl_thrd_stack_release(thr);
+#endif
+  if (res)
+    *res = (int)(intptr_t)code;
+  return thrd_success;
+#else
+  struct impl_thrd_event *ev;
+  int rt = 0;
+  pthread_mutex_lock(&impl_thrd_event_mtx);
+  ev = impl_thrd_event_find(thr);
+  if (!ev)
+    rt = EINVAL;
+  while (rt == 0 && !ev->done)
+    rt = pthread_cond_timedwait(&ev->cond, &impl_thrd_event_mtx, abs_time);
+  pthread_mutex_unlock(&impl_thrd_event_mtx);
+  if (rt == ETIMEDOUT)
+    return thrd_timedout;
+  if (rt != 0)
+    return thrd_error;
+  return thrd_join(thr, res);
+#endif
+  }
+}
+
+int
+thrd_setaffinity(thrd_t thr, const thrd_cpuset_t *set) {
+#if defined(__linux__)
+  cpu_set_t cs;
+  int rt;
+  assert(set != NULL);
+  impl_cpuset_to_native(set, &cs);
+  rt = pthread_setaffinity_np(thr, sizeof(cs), &cs);
+  return (rt == 0) ? thrd_success : impl_sched_error(rt);
+#else
+  (void)thr;
+  (void)set;
+  return thrd_error;
+#endif
+}
+
+int
+thrd_getaffinity(thrd_t thr, thrd_cpuset_t *set) {
+#if defined(__linux__)
+  cpu_set_t cs;
+  assert(set != NULL);
+  if (pthread_getaffinity_np(thr, sizeof(cs), &cs) != 0)
+    return thrd_error;
+  impl_cpuset_from_native(&cs, set);
+  return thrd_success;
+#else
+  (void)thr;
+  (void)set;
+  return thrd_error;
+#endif
+}
+
+int
+thrd_getcpu(void) {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+int
+thrd_cpuset_near(int cpu, int level, thrd_cpuset_t *set) {
+  assert(set != NULL);
+  if (cpu < 0 || cpu >= THRD_CPUSET_SIZE)
+    return thrd_error;
+  {
+#if defined(__linux__)
+  char path[96];
+  if (level == thrd_near_core) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    return impl_cpuset_read(path, set);
+  }
+  if (level == thrd_near_cache)
+    return impl_cpuset_read_llc(cpu, set);
+  if (level == thrd_near_node)
+    return impl_cpuset_read_node(cpu, set);
+#endif
+  (void)level;
+  return thrd_error;
+  }
+}
+
+int
+thrd_sleep_until(const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  {
+#if defined(HAVE_CLOCK_NANOSLEEP)
+  int rt;
+  while ((rt = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, abs_time, NULL)) == EINTR)
+    ;
+  return (rt == 0) ? thrd_success : thrd_error;
+#else
+  struct timespec now, rel;
+  for (;;) {
+    timespec_get(&now, TIME_UTC);
+    rel.tv_sec = abs_time->tv_sec - now.tv_sec;
+    rel.tv_nsec = abs_time->tv_nsec - now.tv_nsec;
+    if (rel.tv_nsec < 0) {
+      rel.tv_sec -= 1;
+      rel.tv_nsec += 1000000000L;
+    }
+    if (rel.tv_sec < 0 || (rel.tv_sec == 0 && rel.tv_nsec == 0))
+      return thrd_success;
+    if (nanosleep(&rel, NULL) != 0 && errno != EINTR)
+      return thrd_error;
+  }
+#endif
+  }
+}
+
+void
+thrd_park(void) {
+  impl_thrd_park(NULL);
+}
+
+int
+thrd_park_until(const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  if (abs_time->tv_nsec < 0 || abs_time->tv_nsec >= 1000000000L)
+    return thrd_error;
+  return impl_thrd_park(abs_time);
+}
+
+int
+thrd_setwaitpolicy(int policy, long spin_nsec) {
+  struct impl_thrd_state *st;
+  if (policy < thrd_wait_block || policy > thrd_wait_hybrid || spin_nsec < 0)
+    return thrd_error;
+  st = impl_thrd_state_self();
+  st->wait_policy = policy;
+  st->wait_spin_nsec = spin_nsec;
+  return thrd_success;
+}
+
+void
+thrd_getwaitpolicy(int *policy, long *spin_nsec) {
+  struct impl_thrd_state *st = impl_thrd_state_self();
+  if (policy)
+    *policy = st->wait_policy;
+  if (spin_nsec)
+    *spin_nsec = st->wait_spin_nsec;
+}
+
+int
+thrd_unpark(thrd_t thr) {
+  struct impl_thrd_state *st = impl_thrd_state_pin(thr);
+  if (!st) {
+    // a thread may hand itself a permit before it ever registered
+    if (!pthread_equal(thr, pthread_self()) || !impl_thrd_state_register())
+      return thrd_error;
+    st = impl_thrd_state_pin(thr);
+  }
+  if (evo_atomic_exchange_u32(&st->park, IMPL_PARK_NOTIFIED, EVO_ATOMIC_RELEASE)
+      == IMPL_PARK_PARKED) {
+#ifdef EMULATED_THREADS_USE_FUTEX
+    impl_futex_wake(&st->park);
+#else
+    pthread_mutex_lock(&st->park_mtx);
+    pthread_cond_signal(&st->park_cnd);
+    pthread_mutex_unlock(&st->park_mtx);
+#endif
+  }
+  impl_thrd_state_unpin(st);
+  return thrd_success;
+}
+
+int
+thrd_index(void) {
+  int index = impl_thrd_index_tls;
+  if (index)
+    return index - 1;
+  return impl_thrd_state_self()->index;
+}
+
+int
+thrd_index_max(void) {
+  return evo_atomic_load_i32(&impl_thrd_index_next, EVO_ATOMIC_ACQUIRE);
+}
+
+int
+thrd_setsched(thrd_t thr, int policy, int priority) {
+  struct sched_param param;
+  int rt;
+  if (policy < thrd_sched_other || policy > thrd_sched_idle
+      || impl_sched_policy_tbl[policy] < 0)
+    return thrd_error;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  rt = pthread_setschedparam(thr, impl_sched_policy_tbl[policy], &param);
+  return (rt == 0) ? thrd_success : impl_sched_error(rt);
+}
+
+int
+thrd_getsched(thrd_t thr, int *policy, int *priority) {
+  struct sched_param param;
+  int native, i;
+  if (pthread_getschedparam(thr, &native, &param) != 0)
+    return thrd_error;
+  for (i = thrd_sched_other; i <= thrd_sched_idle; i++) {
+    if (impl_sched_policy_tbl[i] == native)
+      break;
+  }
+  if (i > thrd_sched_idle)
+    return thrd_error;
+  if (policy)
+    *policy = i;
+  if (priority)
+    *priority = param.sched_priority;
+  return thrd_success;
+}
+
+int
+thrd_setnice(thrd_t thr, int nice) {
+#if defined(__linux__)
+  // Linux keeps the nice value per thread, addressed by its kernel id
+  pid_t tid = impl_thrd_tid(thr);
+  if (tid == 0)
+    return thrd_error;
+  if (setpriority(PRIO_PROCESS, (id_t)tid, nice) != 0)
+    return impl_sched_error(errno);
+  return thrd_success;
+#else
+  (void)thr;
+  (void)nice;
+  return thrd_error;
+#endif
+}
+
+int
+thrd_getnice(thrd_t thr, int *nice) {
+#if defined(__linux__)
+  pid_t tid = impl_thrd_tid(thr);
+  int value;
+  assert(nice != NULL);
+  if (tid == 0)
+    return thrd_error;
+  errno = 0;
+  value = getpriority(PRIO_PROCESS, (id_t)tid);
+  if (value == -1 && errno != 0)
+    return thrd_error;
+  *nice = value;
+  return thrd_success;
+#else
+  (void)thr;
+  (void)nice;
+  return thrd_error;
+#endif
+}
+
+int
+thrd_setlatency_hint(thrd_t thr, long slice_nsec) {
+#if defined(__linux__) && defined(SYS_sched_getattr) && defined(SYS_sched_setattr)
+  struct impl_sched_attr attr;
+  pid_t tid = impl_thrd_tid(thr);
+  if (tid == 0 || slice_nsec < 0)
+    return thrd_error;
+  memset(&attr, 0, sizeof(attr));
+  if (syscall(SYS_sched_getattr, tid, &attr, sizeof(attr), 0) != 0)
+    return impl_sched_error(errno);
+  // only the time-sharing classes take a slice request
+  if (attr.sched_policy != SCHED_OTHER && attr.sched_policy != SCHED_BATCH)
+    return thrd_error;
+  // everything else, reset-on-fork and utilization clamps included, is
+  // written back as read
+  attr.size = sizeof(attr);
+  attr.sched_runtime = (uint64_t)slice_nsec;
+  if (syscall(SYS_sched_setattr, tid, &attr, 0) != 0)
+    return impl_sched_error(errno);
+  // kernels before custom slices accept and ignore the request, and
+  // report no slice for a time-sharing thread
+  if (slice_nsec != 0) {
+    memset(&attr, 0, sizeof(attr));
+    if (syscall(SYS_sched_getattr, tid, &attr, sizeof(attr), 0) != 0
+        || attr.sched_runtime == 0)
+      return thrd_error;
+  }
+  return thrd_success;
+#else
+  (void)thr;
+  (void)slice_nsec;
+  return thrd_error;
+#endif
+}
+
+void
+thrd_attr_init(thrd_attr_t *attr) {
+  assert(attr != NULL);
+  memset(attr, 0, sizeof(*attr));
+}
+
+int
+thrd_create_ex(thrd_t *thr, const thrd_attr_t *attr, thrd_start_t func, void *arg) {
+  return impl_thrd_create(thr, attr, func, arg);
+}
+
+int
+thrd_stack_pool_init(thrd_stack_pool_t *pool, size_t stack_size, size_t count, int flags) {
+#if !defined(HAVE_THRD_CREATE)
+  size_t unit;
+  assert(pool != NULL);
+  memset(pool, 0, sizeof(*pool));
+  pool->guard_size = (size_t)sysconf(_SC_PAGESIZE);
+  pool->flags = flags;
+  unit = (flags & thrd_stack_hugepages) ? EMULATED_THREADS_HUGE_PAGE_SIZE : pool->guard_size;
+  if (stack_size < (size_t)PTHREAD_STACK_MIN)
+    stack_size = (size_t)PTHREAD_STACK_MIN;
+  pool->stack_size = (stack_size + unit - 1) & ~(unit - 1);
+  if (mtx_init(&pool->mtx, mtx_plain) != thrd_success)
+    return thrd_error;
+  while (count--) {
+    void *stack = impl_thrd_stack_map(pool);
+    if (!stack) {
+      thrd_stack_pool_destroy(pool);
+      return thrd_nomem;
+    }
+    impl_thrd_stack_put(pool, stack);
+  }
+  return thrd_success;
+#else
+  assert(pool != NULL);
+  (void)stack_size;
+  (void)count;
+  (void)flags;
+  memset(pool, 0, sizeof(*pool));
+  return thrd_error;
+#endif
+}
+
+void
+thrd_stack_pool_destroy(thrd_stack_pool_t *pool) {
+  assert(pool != NULL);
+#if !defined(HAVE_THRD_CREATE)
+  impl_thrd_stack_reap(pool, 1);
+  impl_thrd_stack_orphan(pool);
+  while (pool->free) {
+    void *stack = pool->free;
+    pool->free = *(void **)stack;
+    impl_thrd_stack_unmap(stack, pool->stack_size, pool->guard_size);
+  }
+  mtx_destroy(&pool->mtx);
+#endif
+}
+
+int
+thrd_setmempolicy(int policy, uint64_t nodes) {
+#if defined(EMULATED_THREADS_MEMPOLICY_MAXNODE)
+  struct impl_mempolicy mp;
+  size_t i;
+  if (policy < thrd_mempolicy_default || policy > thrd_mempolicy_interleave)
+    return thrd_error;
+  if ((policy == thrd_mempolicy_default) != (nodes == 0))
+    return thrd_error;
+  memset(&mp, 0, sizeof(mp));
+  mp.mode = impl_mempolicy_tbl[policy];
+  for (i = 0; i < 64; i++) {
+    if (nodes & ((uint64_t)1 << i))
+      mp.nodes[i / (CHAR_BIT * sizeof(unsigned long))] |= 1UL << (i % (CHAR_BIT * sizeof(unsigned long)));
+  }
+  if (impl_mempolicy_set(&mp) != 0)
+    return (errno == EPERM) ? thrd_noperm : thrd_error;
+  return thrd_success;
+#else
+  return (policy == thrd_mempolicy_default && nodes == 0) ? thrd_success : thrd_error;
+#endif
+}
+
+struct impl_first_touch {
+  char *addr;
+  size_t len;
+};
+
+static int
+impl_first_touch(void *p) {
+  struct impl_first_touch *ft = (struct impl_first_touch *)p;
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  char *c = ft->addr;
+  char *end = ft->addr + ft->len;
+  while (c < end) {
+    *(volatile char *)c = *(volatile char *)c;
+    c = (char *)(((uintptr_t)c | (page - 1)) + 1);
+  }
+  return thrd_success;
+}
+
+int
+thrd_first_touch(void *addr, size_t len, int node) {
+  struct impl_first_touch ft;
+  thrd_attr_t attr;
+  thrd_t thr;
+  int res, rt;
+  ft.addr = (char *)addr;
+  ft.len = len;
+  if (node < 0)
+    return impl_first_touch(&ft);
+  if (node >= 64)
+    return thrd_error;
+  thrd_attr_init(&attr);
+  attr.mempolicy = thrd_mempolicy_bind;
+  attr.mempolicy_nodes = (uint64_t)1 << node;
+  rt = thrd_create_ex(&thr, &attr, impl_first_touch, &ft);
+  if (rt != thrd_success)
+    return rt;
+  if (thrd_join(thr, &res) != thrd_success)
+    return thrd_error;
+  return res;
+}
@@ -0,0 +1,109 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <evo/threads/atomic.h>
+#include <evo/threads/scope.h>
+
+struct impl_scope_param {
+  thrd_scope_t *scope;
+  thrd_start_t func;
+  void *arg;
+};
+
+static void
+impl_scope_fail(thrd_scope_t *scope, int code) {
+  int32_t expected = 0;
+  evo_atomic_cas_i32(&scope->status, &expected, code, EVO_ATOMIC_RELAXED);
+  thrd_scope_cancel(scope);
+}
+
+static void
+impl_scope_parent_cancelled(void *p) {
+  thrd_scope_cancel((thrd_scope_t *)p);
+}
+
+static int
+impl_scope_routine(void *p) {
+  struct impl_scope_param pack = *((struct impl_scope_param *)p);
+  int code;
+  free(p);
+  code = pack.func(pack.arg);
+  // cancel the siblings now rather than when the parent gets to join us
+  if (code != 0)
+    impl_scope_fail(pack.scope, code);
+  return code;
+}
+
+
+int
+thrd_scope_open(thrd_scope_t *scope, const thrd_scope_t *parent) {
+  assert(scope != NULL);
+  scope->parent = parent;
+  scope->status = 0;
+  if (cancel_source_init(&scope->cancel) != thrd_success)
+    return thrd_error;
+  if (thrd_group_init(&scope->group) != thrd_success) {
+    cancel_source_destroy(&scope->cancel);
+    return thrd_error;
+  }
+  if (parent
+      && cancel_register(thrd_scope_token(parent), &scope->parent_cb,
+                         impl_scope_parent_cancelled, scope) != thrd_success)
+    thrd_scope_cancel(scope);
+  return thrd_success;
+}
+
+int
+thrd_scope_spawn(thrd_scope_t *scope, thrd_start_t func, void *arg) {
+  struct impl_scope_param *pack;
+  int rt;
+  assert(scope != NULL);
+  if (thrd_scope_cancelled(scope))
+    return thrd_error;
+  pack = (struct impl_scope_param *)malloc(sizeof(struct impl_scope_param));
+  if (!pack)
+    return thrd_nomem;
+  pack->scope = scope;
+  pack->func = func;
+  pack->arg = arg;
+  rt = thrd_group_create(&scope->group, NULL, impl_scope_routine, pack);
+  if (rt != thrd_success)
+    free(pack);
+  return rt;
+}
+
+void
+thrd_scope_cancel(thrd_scope_t *scope) {
+  assert(scope != NULL);
+  cancel_request(&scope->cancel);
+}
+
+int
+thrd_scope_close(thrd_scope_t *scope, int *res) {
+  int rt = thrd_success;
+  assert(scope != NULL);
+  for (;;) {
+    size_t count;
+    int code;
+    // children may spawn siblings, so re-check under the lock
+    mtx_lock(&scope->group.mtx);
+    count = scope->group.count;
+    mtx_unlock(&scope->group.mtx);
+    if (count == 0)
+      break;
+    if (thrd_group_join_any(&scope->group, NULL, &code) != thrd_success) {
+      rt = thrd_error;
+      continue;
+    }
+    // a child that left through thrd_exit() bypassed impl_scope_routine
+    if (code != 0)
+      impl_scope_fail(scope, code);
+  }
+  if (scope->parent)
+    cancel_unregister(thrd_scope_token(scope->parent), &scope->parent_cb);
+  thrd_group_destroy(&scope->group);
+  cancel_source_destroy(&scope->cancel);
+  if (res)
+    *res = evo_atomic_load_i32(&scope->status, EVO_ATOMIC_RELAXED);
+  return rt;
+}
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include <evo/threads/threads.h>
+#include <evo/threads/atomic.h>
 
 #ifndef WIN32_LEAN_AND_MEAN
 # define WIN32_LEAN_AND_MEAN 1
@@ -50,10 +51,14 @@ Implementation limits:
   - Emulated `mtx_timelock()' with mtx_trylock() + *busy loop*
 */
 static void impl_tss_dtor_invoke(void);  // forward decl.
+struct impl_thrd_state;
+static void impl_thrd_state_adopt(struct impl_thrd_state *);  // forward decl.
+static void impl_thrd_state_forget(HANDLE);  // forward decl.
 
 struct impl_thrd_param {
   thrd_start_t func;
   void *arg;
+  struct impl_thrd_state *state;
 };
 
 static unsigned __stdcall impl_thrd_routine(void *p) {
@@ -61,7 +66,9 @@ static unsigned __stdcall impl_thrd_routine(void *p) {
   int code;
   memcpy(&pack, p, sizeof(struct impl_thrd_param));
   free(p);
-  code = pack.func(pack.arg);
+  impl_thrd_state_adopt(pack.state);
+  // no func: thrd_create_ex() failed to set the thread up before it ran
+  code = pack.func ? pack.func(pack.arg) : 0;
   impl_tss_dtor_invoke();
   return (unsigned)code;
 }
@@ -276,23 +283,7 @@ mtx_unlock(mtx_t *mtx) {
 // 7.25.5.1
 int
 thrd_create(thrd_t *thr, thrd_start_t func, void *arg) {
-  struct impl_thrd_param *pack;
-  uintptr_t handle;
-  assert(thr != NULL);
-  pack = (struct impl_thrd_param *)malloc(sizeof(struct impl_thrd_param));
-  if (!pack) return thrd_nomem;
-  pack->func = func;
-  pack->arg = arg;
-  handle = _beginthreadex(NULL, 0, impl_thrd_routine, pack, 0, NULL);
-  if (handle == 0) {
-    free(pack);
-    if (errno == EAGAIN || errno == EACCES) {
-      return thrd_nomem;
-    }
-    return thrd_error;
-  }
-  *thr = (thrd_t)handle;
-  return thrd_success;
+  return thrd_create_ex(thr, NULL, func, arg);
 }
 
 #if 0
@@ -339,6 +330,7 @@ thrd_current(void)
 // 7.25.5.3
 int
 thrd_detach(thrd_t thr) {
+  impl_thrd_state_forget(thr);
   CloseHandle(thr);
   return thrd_success;
 }
@@ -357,11 +349,12 @@ thrd_exit(int res) {
   _endthreadex((unsigned)res);
 }
 
-// 7.25.5.6
-int
-thrd_join(thrd_t thr, int *res) {
+static int impl_thrd_join(thrd_t thr, int *res, DWORD timeout) {
   DWORD w, code;
-  w = WaitForSingleObject(thr, INFINITE);
+  w = WaitForSingleObject(thr, timeout);
+  if (w == WAIT_TIMEOUT) {
+    return thrd_timedout;
+  }
   if (w != WAIT_OBJECT_0) {
     return thrd_error;
   }
@@ -376,6 +369,12 @@ thrd_join(thrd_t thr, int *res) {
   return thrd_success;
 }
 
+// 7.25.5.6
+int
+thrd_join(thrd_t thr, int *res) {
+  return impl_thrd_join(thr, res, INFINITE);
+}
+
 // 7.25.5.7
 int
 thrd_sleep(const struct timespec *time_point, struct timespec *remaining) {
@@ -432,3 +431,784 @@ tss_set(tss_t key, void *val) {
       ? thrd_success
       : thrd_error;
 }
+
+
+/*---------------------- Per-thread state -----------------------*/
+/*
+ * Keyed by thread id, since thrd_t handles of one thread may differ; the
+ * handle thrd_create_ex() returned is remembered too, so that unparking
+ * through it needs no GetThreadId() call. thrd_create_ex() sets the
+ * record up before it returns, any other thread registers on first use.
+ * The permit of thrd_park() is a word as on POSIX; an auto-reset event
+ * wakes a thread asleep on it.
+ *
+ * Lookups take no lock: they pin the record through `users` and check it
+ * is still live, and a record is only recycled, never freed, once the
+ * pins drained. Released by a TSS destructor, i.e. when a thread started
+ * by thrd_create() exits; the record of a thread that exited without one
+ * is retired when its id is handed out again.
+ * Registering also hands out the thread's dense index.
+ */
+#define IMPL_PARK_EMPTY    0u
+#define IMPL_PARK_NOTIFIED 1u
+#define IMPL_PARK_PARKED   UINT32_MAX  /* EMPTY - 1 */
+
+#define IMPL_STATE_NEW  0u  /* not linked yet */
+#define IMPL_STATE_LIVE 1u  /* linked, its thread runs */
+#define IMPL_STATE_DEAD 2u  /* unlinked, its thread exited */
+
+struct impl_thrd_state {
+  struct impl_thrd_state *next;
+  struct impl_thrd_state *free_next;
+  uint32_t id;
+  uintptr_t handle; /* from thrd_create_ex(), or 0 */
+  uint32_t state;   /* IMPL_STATE_* */
+  uint32_t users;   /* pins, plus one held by the creator until linked */
+  int index;
+  uint32_t park;    /* IMPL_PARK_* */
+  HANDLE park_evt;  /* set only for a PARKED thread */
+  int wait_policy;  /* thrd_wait_*, of the thread itself */
+  long wait_spin_nsec;
+};
+
+static SRWLOCK impl_thrd_state_lock = SRWLOCK_INIT;
+static struct impl_thrd_state *impl_thrd_state_list;
+static struct impl_thrd_state *impl_thrd_state_free;
+static once_flag impl_thrd_state_once = ONCE_FLAG_INIT;
+static tss_t impl_thrd_state_key;
+
+static int *impl_thrd_index_free;  /* released indices, lowest on top */
+static int impl_thrd_index_nfree;
+static int impl_thrd_index_cap;
+static int32_t impl_thrd_index_next; /* high-water mark */
+static _Thread_local int impl_thrd_index_tls; /* index + 1 */
+
+// requires impl_thrd_state_lock
+static int impl_thrd_index_acquire(void) {
+  if (impl_thrd_index_nfree > 0) {
+    return impl_thrd_index_free[--impl_thrd_index_nfree];
+  }
+  // size the free stack for every index handed out, so release never fails
+  if (impl_thrd_index_next == impl_thrd_index_cap) {
+    int cap = impl_thrd_index_cap ? impl_thrd_index_cap * 2 : 64;
+    int *tbl = (int *)realloc(impl_thrd_index_free, (size_t)cap * sizeof(int));
+    if (!tbl) {
+      return -1;
+    }
+    impl_thrd_index_free = tbl;
+    impl_thrd_index_cap = cap;
+  }
+  evo_atomic_store_i32(&impl_thrd_index_next, impl_thrd_index_next + 1, EVO_ATOMIC_RELEASE);
+  return impl_thrd_index_next - 1;
+}
+
+// requires impl_thrd_state_lock
+static void impl_thrd_index_release(int index) {
+  int i;
+  // keep the stack sorted descending so the lowest index is reused first
+  for (i = impl_thrd_index_nfree; i > 0 && impl_thrd_index_free[i - 1] < index; i--) {
+    impl_thrd_index_free[i] = impl_thrd_index_free[i - 1];
+  }
+  impl_thrd_index_free[i] = index;
+  impl_thrd_index_nfree++;
+}
+
+// requires impl_thrd_state_lock
+static void impl_thrd_state_unlink(struct impl_thrd_state *st) {
+  struct impl_thrd_state **link;
+  for (link = &impl_thrd_state_list; *link != st; link = &(*link)->next)
+    ;
+  evo_atomic_store_ptr((void **)link, st->next, EVO_ATOMIC_RELEASE);
+  evo_atomic_store_u32(&st->state, IMPL_STATE_DEAD, EVO_ATOMIC_SEQ_CST);
+  impl_thrd_index_release(st->index);
+}
+
+/* Waits for the pins of an unlinked record to drain and recycles it */
+static void impl_thrd_state_retire(struct impl_thrd_state *st) {
+  while (evo_atomic_load_u32(&st->users, EVO_ATOMIC_SEQ_CST) != 0) {
+    SwitchToThread();
+  }
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  st->free_next = impl_thrd_state_free;
+  impl_thrd_state_free = st;
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+}
+
+/* A fresh record with an index, pinned once on behalf of its creator */
+static struct impl_thrd_state *impl_thrd_state_alloc(void) {
+  struct impl_thrd_state *st;
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  st = impl_thrd_state_free;
+  if (st) {
+    impl_thrd_state_free = st->free_next;
+  }
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+  if (!st) {
+    st = (struct impl_thrd_state *)calloc(1, sizeof(struct impl_thrd_state));
+    if (!st) {
+      return NULL;
+    }
+    st->park_evt = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!st->park_evt) {
+      free(st);
+      return NULL;
+    }
+  }
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  st->index = impl_thrd_index_acquire();
+  if (st->index < 0) {
+    st->free_next = impl_thrd_state_free;
+    impl_thrd_state_free = st;
+    st = NULL;
+  }
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+  if (!st) {
+    return NULL;
+  }
+  // a late SetEvent() of the previous owner may still be pending
+  ResetEvent(st->park_evt);
+  st->park = IMPL_PARK_EMPTY;
+  st->wait_policy = thrd_wait_block;
+  st->wait_spin_nsec = 0;
+  evo_atomic_store_u32(&st->state, IMPL_STATE_NEW, EVO_ATOMIC_RELAXED);
+  // a stale lookup may hold a transient pin, so add rather than store
+  evo_atomic_fetch_add_u32(&st->users, 1, EVO_ATOMIC_RELAXED);
+  return st;
+}
+
+/* Makes `st` reachable from thread `id` unless the thread already exited */
+static void impl_thrd_state_link(struct impl_thrd_state *st, DWORD id, HANDLE handle) {
+  struct impl_thrd_state *it, *stale = NULL;
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  if (st->state == IMPL_STATE_NEW) {
+    // ids are unique among running threads: a live record with this one
+    // belonged to a thread that exited without a TSS destructor
+    for (it = impl_thrd_state_list; it; it = it->next) {
+      if (it->id == (uint32_t)id) {
+        stale = it;
+        impl_thrd_state_unlink(it);
+        break;
+      }
+    }
+    evo_atomic_store_u32(&st->id, (uint32_t)id, EVO_ATOMIC_RELAXED);
+    evo_atomic_store_uptr(&st->handle, (uintptr_t)handle, EVO_ATOMIC_RELAXED);
+    evo_atomic_store_ptr((void **)&st->next, impl_thrd_state_list, EVO_ATOMIC_RELAXED);
+    evo_atomic_store_u32(&st->state, IMPL_STATE_LIVE, EVO_ATOMIC_SEQ_CST);
+    evo_atomic_store_ptr((void **)&impl_thrd_state_list, st, EVO_ATOMIC_RELEASE);
+  }
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+  if (stale) {
+    impl_thrd_state_retire(stale);
+  }
+}
+
+/* Creation failed: the thread never ran */
+static void impl_thrd_state_discard(struct impl_thrd_state *st) {
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  impl_thrd_index_release(st->index);
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELAXED);
+  impl_thrd_state_retire(st);
+}
+
+static void impl_thrd_state_release(void *p) {
+  struct impl_thrd_state *st = (struct impl_thrd_state *)p;
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  if (st->state == IMPL_STATE_LIVE) {
+    impl_thrd_state_unlink(st);
+  } else if (st->state == IMPL_STATE_NEW) {
+    // the creator has not linked it yet and now never will
+    evo_atomic_store_u32(&st->state, IMPL_STATE_DEAD, EVO_ATOMIC_SEQ_CST);
+    impl_thrd_index_release(st->index);
+  }
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+  impl_thrd_index_tls = 0;
+  impl_thrd_state_retire(st);
+}
+
+static void impl_thrd_state_init(void) {
+  tss_create(&impl_thrd_state_key, impl_thrd_state_release);
+}
+
+/* Binds `st` to the calling thread */
+static void impl_thrd_state_adopt(struct impl_thrd_state *st) {
+  call_once(&impl_thrd_state_once, impl_thrd_state_init);
+  tss_set(impl_thrd_state_key, st);
+  impl_thrd_index_tls = st->index + 1;
+}
+
+/* Live record whose `id` (or `handle`) matches, pinned; NULL if none */
+static struct impl_thrd_state *impl_thrd_state_pin(int by_handle, uintptr_t key) {
+  struct impl_thrd_state *st;
+  st = (struct impl_thrd_state *)evo_atomic_load_ptr((void **)&impl_thrd_state_list, EVO_ATOMIC_ACQUIRE);
+  for (; st; st = (struct impl_thrd_state *)evo_atomic_load_ptr((void **)&st->next, EVO_ATOMIC_ACQUIRE)) {
+    uintptr_t v = by_handle
+      ? evo_atomic_load_uptr(&st->handle, EVO_ATOMIC_RELAXED)
+      : (uintptr_t)evo_atomic_load_u32(&st->id, EVO_ATOMIC_RELAXED);
+    if (v != key) {
+      continue;
+    }
+    // pairs with the DEAD store and `users` load of the release
+    evo_atomic_fetch_add_u32(&st->users, 1, EVO_ATOMIC_SEQ_CST);
+    if (evo_atomic_load_u32(&st->state, EVO_ATOMIC_SEQ_CST) == IMPL_STATE_LIVE) {
+      v = by_handle ? st->handle : (uintptr_t)st->id;
+      if (v == key) {
+        return st;
+      }
+    }
+    evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/* `handle` is about to be closed, and its value may be reused */
+static void impl_thrd_state_forget(HANDLE handle) {
+  struct impl_thrd_state *st;
+  AcquireSRWLockExclusive(&impl_thrd_state_lock);
+  for (st = impl_thrd_state_list; st; st = st->next) {
+    if (st->handle == (uintptr_t)handle) {
+      evo_atomic_store_uptr(&st->handle, 0, EVO_ATOMIC_RELAXED);
+    }
+  }
+  ReleaseSRWLockExclusive(&impl_thrd_state_lock);
+}
+
+static void impl_thrd_state_unpin(struct impl_thrd_state *st) {
+  evo_atomic_fetch_sub_u32(&st->users, 1, EVO_ATOMIC_RELEASE);
+}
+
+static struct impl_thrd_state *impl_thrd_state_register(void) {
+  struct impl_thrd_state *st;
+  call_once(&impl_thrd_state_once, impl_thrd_state_init);
+  st = (struct impl_thrd_state *)tss_get(impl_thrd_state_key);
+  if (st) {
+    return st;
+  }
+  st = impl_thrd_state_alloc();
+  if (!st) {
+    return NULL;
+  }
+  impl_thrd_state_link(st, GetCurrentThreadId(), NULL);
+  impl_thrd_state_adopt(st);
+  return st;
+}
+
+static struct impl_thrd_state *impl_thrd_state_self(void) {
+  struct impl_thrd_state *st = impl_thrd_state_register();
+  if (!st) {
+    abort(); /* out of memory before the thread could ever block */
+  }
+  return st;
+}
+/*
+ * Spinning part of the poll and hybrid wait policies: thrd_success once
+ * the permit is taken, thrd_timedout after `*timeout`, thrd_busy when
+ * the hybrid budget is spent, with `*timeout` reduced by the time spun.
+ * The word stays EMPTY meanwhile, so unpark never sets the event.
+ */
+static int impl_thrd_park_spin(struct impl_thrd_state *st, DWORD *timeout) {
+  int poll = st->wait_policy == thrd_wait_poll;
+  LARGE_INTEGER freq, start, now;
+  unsigned long long elapsed_ns = 0;
+  unsigned n;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&start);
+  for (n = 1;; n++) {
+    uint32_t expected = IMPL_PARK_NOTIFIED;
+    if (evo_atomic_load_u32(&st->park, EVO_ATOMIC_RELAXED) == IMPL_PARK_NOTIFIED
+        && evo_atomic_cas_u32(&st->park, &expected, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE)) {
+      return thrd_success;
+    }
+    evo_cpu_relax();
+    if ((n & 63) == 0) {
+      unsigned long long ticks;
+      QueryPerformanceCounter(&now);
+      ticks = (unsigned long long)(now.QuadPart - start.QuadPart);
+      elapsed_ns = ticks / freq.QuadPart * 1000000000ULL
+                   + ticks % freq.QuadPart * 1000000000ULL / freq.QuadPart;
+      if (*timeout != INFINITE && elapsed_ns >= *timeout * 1000000ULL) {
+        return thrd_timedout;
+      }
+      if (!poll && elapsed_ns >= (unsigned long long)st->wait_spin_nsec) {
+        break;
+      }
+    }
+  }
+  if (*timeout != INFINITE) {
+    *timeout -= (DWORD)(elapsed_ns / 1000000ULL);
+  }
+  return thrd_busy;
+}
+
+static int impl_thrd_park(DWORD timeout) {
+  struct impl_thrd_state *st = impl_thrd_state_self();
+  DWORD start, elapsed, w;
+  if (st->wait_policy != thrd_wait_block) {
+    int rt = impl_thrd_park_spin(st, &timeout);
+    if (rt != thrd_busy) {
+      return rt;
+    }
+  }
+
+  // NOTIFIED -> EMPTY consumes the permit, EMPTY -> PARKED announces a sleeper
+  if (evo_atomic_fetch_sub_u32(&st->park, 1, EVO_ATOMIC_ACQUIRE) == IMPL_PARK_NOTIFIED) {
+    return thrd_success;
+  }
+
+  start = GetTickCount();
+  for (;;) {
+    uint32_t expected = IMPL_PARK_NOTIFIED;
+    elapsed = GetTickCount() - start;
+    w = WaitForSingleObject(st->park_evt,
+                            (timeout == INFINITE) ? INFINITE
+                            : (elapsed < timeout) ? timeout - elapsed : 0);
+    if (w != WAIT_OBJECT_0) {
+      if (evo_atomic_exchange_u32(&st->park, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE)
+          == IMPL_PARK_NOTIFIED) {
+        return thrd_success;
+      }
+      return (w == WAIT_TIMEOUT) ? thrd_timedout : thrd_error;
+    }
+    // a signal left over from an earlier park finds the word still PARKED
+    if (evo_atomic_cas_u32(&st->park, &expected, IMPL_PARK_EMPTY, EVO_ATOMIC_ACQUIRE)) {
+      return thrd_success;
+    }
+  }
+}
+
+
+/*-------------------------- Scheduling -------------------------*/
+/*
+ * Windows has a single priority level per thread, relative to the
+ * process priority class; both the scheduling class and the nice value
+ * are mapped onto it.
+ */
+static const int impl_sched_policy_tbl[] = {
+  THREAD_PRIORITY_NORMAL,        /* thrd_sched_other */
+  THREAD_PRIORITY_TIME_CRITICAL, /* thrd_sched_fifo */
+  THREAD_PRIORITY_TIME_CRITICAL, /* thrd_sched_rr */
+  THREAD_PRIORITY_BELOW_NORMAL,  /* thrd_sched_batch */
+  THREAD_PRIORITY_IDLE,          /* thrd_sched_idle */
+};
+
+static int impl_sched_error(void) {
+  return (GetLastError() == ERROR_ACCESS_DENIED) ? thrd_noperm : thrd_error;
+}
+
+static int impl_nice2prio(int nice) {
+  if (nice < -10) {
+    return THREAD_PRIORITY_HIGHEST;
+  }
+  if (nice < 0) {
+    return THREAD_PRIORITY_ABOVE_NORMAL;
+  }
+  if (nice == 0) {
+    return THREAD_PRIORITY_NORMAL;
+  }
+  if (nice <= 10) {
+    return THREAD_PRIORITY_BELOW_NORMAL;
+  }
+  return THREAD_PRIORITY_LOWEST;
+}
+
+static int impl_prio2nice(int prio) {
+  if (prio >= THREAD_PRIORITY_HIGHEST) {
+    return -20;
+  }
+  if (prio <= THREAD_PRIORITY_LOWEST) {
+    return 19;
+  }
+  return -prio * 10;
+}
+
+
+/*------------------------ CPU placement ------------------------*/
+/*
+ * Only the first 64 CPUs, processor group 0, can be addressed through a
+ * thread affinity mask.
+ */
+static int impl_cpuset2mask(const thrd_cpuset_t *set, DWORD_PTR *mask) {
+  size_t i;
+  for (i = 1; i < THRD_CPUSET_SIZE / 64; i++) {
+    if (set->bits[i]) {
+      return 0;
+    }
+  }
+  *mask = (DWORD_PTR)set->bits[0];
+  return *mask != 0 && (uint64_t)*mask == set->bits[0];
+}
+
+static void impl_mask2cpuset(ULONG_PTR mask, thrd_cpuset_t *set) {
+  memset(set, 0, sizeof(*set));
+  set->bits[0] = (uint64_t)mask;
+}
+
+
+/*------------------------- Extensions --------------------------*/
+int
+thrd_tryjoin(thrd_t thr, int *res) {
+  int rt = impl_thrd_join(thr, res, 0);
+  return (rt == thrd_timedout) ? thrd_busy : rt;
+}
+
+int
+thrd_join_until(thrd_t thr, int *res, const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  return impl_thrd_join(thr, res, impl_abs2relmsec(abs_time));
+}
+
+int
+thrd_setaffinity(thrd_t thr, const thrd_cpuset_t *set) {
+  DWORD_PTR mask;
+  assert(set != NULL);
+  if (!impl_cpuset2mask(set, &mask)) {
+    return thrd_error;
+  }
+  if (!SetThreadAffinityMask(thr, mask)) {
+    return impl_sched_error();
+  }
+  return thrd_success;
+}
+
+int
+thrd_getaffinity(thrd_t thr, thrd_cpuset_t *set) {
+#if _WIN32_WINNT >= 0x0601
+  GROUP_AFFINITY affinity;
+  assert(set != NULL);
+  if (!GetThreadGroupAffinity(thr, &affinity)) {
+    return impl_sched_error();
+  }
+  // the mask is relative to the group: only group 0 maps onto a set
+  if (affinity.Group != 0) {
+    return thrd_error;
+  }
+  impl_mask2cpuset(affinity.Mask, set);
+#else
+  // THREAD_BASIC_INFORMATION, the only way to read the mask before Win7
+  struct {
+    LONG exit_status;
+    PVOID teb;
+    HANDLE process, thread;
+    ULONG_PTR affinity;
+    LONG priority, base_priority;
+  } info;
+  typedef LONG (WINAPI *query_fn)(HANDLE, int, PVOID, ULONG, ULONG *);
+  query_fn query;
+  assert(set != NULL);
+  query = (query_fn)(void (*)(void))GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtQueryInformationThread");
+  if (!query || query(thr, 0 /* ThreadBasicInformation */, &info, sizeof(info), NULL) < 0) {
+    return thrd_error;
+  }
+  impl_mask2cpuset(info.affinity, set);
+#endif
+  return thrd_success;
+}
+
+int
+thrd_getcpu(void) {
+  return (int)GetCurrentProcessorNumber();
+}
+
+int
+thrd_cpuset_near(int cpu, int level, thrd_cpuset_t *set) {
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info, *it;
+  LOGICAL_PROCESSOR_RELATIONSHIP rel;
+  DWORD len = 0, i;
+  ULONG_PTR bit, found = 0;
+  BYTE best_level = 0;
+  assert(set != NULL);
+  if (cpu < 0 || cpu >= 64 || cpu >= (int)(sizeof(ULONG_PTR) * CHAR_BIT)) {
+    return thrd_error;
+  }
+  if (level == thrd_near_core) {
+    rel = RelationProcessorCore;
+  } else if (level == thrd_near_cache) {
+    rel = RelationCache;
+  } else if (level == thrd_near_node) {
+    rel = RelationNumaNode;
+  } else {
+    return thrd_error;
+  }
+  bit = (ULONG_PTR)1 << cpu;
+  GetLogicalProcessorInformation(NULL, &len);
+  info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *)malloc(len);
+  if (!info) {
+    return thrd_nomem;
+  }
+  if (!GetLogicalProcessorInformation(info, &len)) {
+    free(info);
+    return thrd_error;
+  }
+  for (i = 0; i < len / sizeof(*info); i++) {
+    it = &info[i];
+    if (it->Relationship != rel || !(it->ProcessorMask & bit)) {
+      continue;
+    }
+    // of the caches, the last level one
+    if (rel == RelationCache && it->Cache.Level <= best_level) {
+      continue;
+    }
+    if (rel == RelationCache) {
+      best_level = it->Cache.Level;
+    }
+    found = it->ProcessorMask;
+  }
+  free(info);
+  if (!found) {
+    return thrd_error;
+  }
+  impl_mask2cpuset(found, set);
+  return thrd_success;
+}
+
+int
+thrd_sleep_until(const struct timespec *abs_time) {
+  DWORD ms;
+  assert(abs_time != NULL);
+  // Sleep() rounds to the timer tick; go again until the deadline passed
+  while ((ms = impl_abs2relmsec(abs_time)) != 0) {
+    Sleep(ms);
+  }
+  return thrd_success;
+}
+
+void
+thrd_park(void) {
+  impl_thrd_park(INFINITE);
+}
+
+int
+thrd_park_until(const struct timespec *abs_time) {
+  assert(abs_time != NULL);
+  if (abs_time->tv_nsec < 0 || abs_time->tv_nsec >= 1000000000L) {
+    return thrd_error;
+  }
+  return impl_thrd_park(impl_abs2relmsec(abs_time));
+}
+
+int
+thrd_setwaitpolicy(int policy, long spin_nsec) {
+  struct impl_thrd_state *st;
+  if (policy < thrd_wait_block || policy > thrd_wait_hybrid || spin_nsec < 0) {
+    return thrd_error;
+  }
+  st = impl_thrd_state_self();
+  st->wait_policy = policy;
+  st->wait_spin_nsec = spin_nsec;
+  return thrd_success;
+}
+
+void
+thrd_getwaitpolicy(int *policy, long *spin_nsec) {
+  struct impl_thrd_state *st = impl_thrd_state_self();
+  if (policy) {
+    *policy = st->wait_policy;
+  }
+  if (spin_nsec) {
+    *spin_nsec = st->wait_spin_nsec;
+  }
+}
+
+int
+thrd_unpark(thrd_t thr) {
+  struct impl_thrd_state *st = impl_thrd_state_pin(1, (uintptr_t)thr);
+  if (!st) {
+    DWORD id = GetThreadId(thr);
+    st = impl_thrd_state_pin(0, (uintptr_t)id);
+    // a thread may hand itself a permit before it ever registered
+    if (!st && id == GetCurrentThreadId() && impl_thrd_state_register()) {
+      st = impl_thrd_state_pin(0, (uintptr_t)id);
+    }
+    if (!st) {
+      return thrd_error;
+    }
+  }
+  if (evo_atomic_exchange_u32(&st->park, IMPL_PARK_NOTIFIED, EVO_ATOMIC_RELEASE) == IMPL_PARK_PARKED) {
+    SetEvent(st->park_evt);
+  }
+  impl_thrd_state_unpin(st);
+  return thrd_success;
+}
+
+int
+thrd_index(void) {
+  int index = impl_thrd_index_tls;
+  if (index) {
+    return index - 1;
+  }
+  return impl_thrd_state_self()->index;
+}
+
+int
+thrd_index_max(void) {
+  return evo_atomic_load_i32(&impl_thrd_index_next, EVO_ATOMIC_ACQUIRE);
+}
+
+int
+thrd_setsched(thrd_t thr, int policy, int priority) {
+  (void)priority;
+  if (policy < thrd_sched_other || policy > thrd_sched_idle) {
+    return thrd_error;
+  }
+  if (!SetThreadPriority(thr, impl_sched_policy_tbl[policy])) {
+    return impl_sched_error();
+  }
+  return thrd_success;
+}
+
+int
+thrd_getsched(thrd_t thr, int *policy, int *priority) {
+  int prio = GetThreadPriority(thr);
+  if (prio == THREAD_PRIORITY_ERROR_RETURN) {
+    return thrd_error;
+  }
+  if (policy) {
+    if (prio == THREAD_PRIORITY_TIME_CRITICAL) {
+      *policy = thrd_sched_fifo;
+    } else if (prio == THREAD_PRIORITY_IDLE) {
+      *policy = thrd_sched_idle;
+    } else {
+      *policy = thrd_sched_other;
+    }
+  }
+  if (priority) {
+    *priority = 0;
+  }
+  return thrd_success;
+}
+
+int
+thrd_setnice(thrd_t thr, int nice) {
+  if (!SetThreadPriority(thr, impl_nice2prio(nice))) {
+    return impl_sched_error();
+  }
+  return thrd_success;
+}
+
+int
+thrd_getnice(thrd_t thr, int *nice) {
+  int prio = GetThreadPriority(thr);
+  assert(nice != NULL);
+  if (prio == THREAD_PRIORITY_ERROR_RETURN) {
+    return thrd_error;
+  }
+  *nice = impl_prio2nice(prio);
+  return thrd_success;
+}
+
+int
+thrd_setlatency_hint(thrd_t thr, long slice_nsec) {
+  (void)thr;
+  (void)slice_nsec;
+  return thrd_error;
+}
+
+void
+thrd_attr_init(thrd_attr_t *attr) {
+  assert(attr != NULL);
+  memset(attr, 0, sizeof(*attr));
+}
+
+int
+thrd_create_ex(thrd_t *thr, const thrd_attr_t *attr, thrd_start_t func, void *arg) {
+  struct impl_thrd_param *pack;
+  struct impl_thrd_state *state;
+  uintptr_t handle;
+  unsigned id;
+  unsigned stack_size = 0;
+  unsigned flags = 0;
+  DWORD_PTR mask = 0;
+  assert(thr != NULL);
+  if (attr) {
+    // no per-thread memory policy or caller-provided stacks on Windows
+    if (attr->mempolicy != thrd_mempolicy_default || attr->stack_pool
+        || attr->stack_size > UINT_MAX) {
+      return thrd_error;
+    }
+    if (attr->affinity && !impl_cpuset2mask(attr->affinity, &mask)) {
+      return thrd_error;
+    }
+    stack_size = (unsigned)attr->stack_size;
+  }
+  if (stack_size) {
+    flags |= STACK_SIZE_PARAM_IS_A_RESERVATION;
+  }
+  if (mask) {
+    flags |= CREATE_SUSPENDED;
+  }
+  // the creator is registered too, so its new thread can unpark it
+  if (!impl_thrd_state_register()) {
+    return thrd_nomem;
+  }
+  pack = (struct impl_thrd_param *)malloc(sizeof(struct impl_thrd_param));
+  if (!pack) return thrd_nomem;
+  pack->func = func;
+  pack->arg = arg;
+  pack->state = state = impl_thrd_state_alloc();
+  if (!state) {
+    free(pack);
+    return thrd_nomem;
+  }
+  handle = _beginthreadex(NULL, stack_size, impl_thrd_routine, pack, flags, &id);
+  if (handle == 0) {
+    impl_thrd_state_discard(state);
+    free(pack);
+    if (errno == EAGAIN || errno == EACCES) {
+      return thrd_nomem;
+    }
+    return thrd_error;
+  }
+  if (mask && !SetThreadAffinityMask((HANDLE)handle, mask)) {
+    // let the thread run to its end without calling func
+    pack->func = NULL;
+    impl_thrd_state_unpin(state);
+    ResumeThread((HANDLE)handle);
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+    return thrd_error;
+  }
+  // linked before returning, so `*thr` can be unparked right away
+  impl_thrd_state_link(state, id, (HANDLE)handle);
+  if (mask) {
+    ResumeThread((HANDLE)handle);
+  }
+  *thr = (thrd_t)handle;
+  return thrd_success;
+}
+
+int
+thrd_stack_pool_init(thrd_stack_pool_t *pool, size_t stack_size, size_t count, int flags) {
+  assert(pool != NULL);
+  (void)stack_size;
+  (void)count;
+  (void)flags;
+  memset(pool, 0, sizeof(*pool));
+  return thrd_error;
+}
+
+void
+thrd_stack_pool_destroy(thrd_stack_pool_t *pool) {
+  (void)pool;
+}
+
+int
+thrd_setmempolicy(int policy, uint64_t nodes) {
+  return (policy == thrd_mempolicy_default && nodes == 0) ? thrd_success : thrd_error;
+}
+
+int
+thrd_first_touch(void *addr, size_t len, int node) {
+  SYSTEM_INFO si;
+  char *c = (char *)addr;
+  char *end = c + len;
+  if (node >= 0) {
+    return thrd_error;
+  }
+  GetSystemInfo(&si);
+  while (c < end) {
+    *(volatile char *)c = *(volatile char *)c;
+    c = (char *)(((uintptr_t)c | (si.dwPageSize - 1)) + 1);
+  }
+  return thrd_success;
+}